@@ -0,0 +1,114 @@
+/*
+	Measures the effect of huge pages on the precomputed tables: the time to build a table, and the rate of random lookups into it, against the table size.
+
+	Each table is built three ways: as the std::vector the tables used to be (value-initialised, then written), and as a HugePageArray on standard pages and on huge pages (see -huge-pages), initialised and written a tile at a time as in SequenceScanner::Precompute. The lookups are made at uniformly random indices, which is the access pattern of a scan once the table is much larger than the cache.
+
+	Build with 'make benchmark', and run .build/bench/hugePageBenchmark [max length] [lookups]
+*/
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include "../src/scan/SequenceScanner.h"
+#include "../src/tools/hugePageArray.h"
+
+//stands in for FillTable's writes, so that every entry is written once after initialisation
+template<class Table>
+void write(Table & table, size_t start, size_t end)
+{
+	for (size_t i = start; i < end; ++i)
+	{
+		table[i].CheckElement(static_cast<double>(i & 1023),-1.0,1);
+	}
+}
+
+double milliseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//looks up every index, and returns a checksum (so that the lookups cannot be optimised away)
+template<class Table>
+double lookup(const Table & table, const std::vector<uint64_t> & indices)
+{
+	double checksum = 0;
+	for (uint64_t index : indices)
+	{
+		checksum += table[index].Score;
+	}
+	return checksum;
+}
+
+//the best of a few repeats, in millions of lookups per second
+template<class Table>
+double lookupRate(const Table & table, const std::vector<uint64_t> & indices)
+{
+	double best = 0;
+	for (int repeat = 0; repeat < 3; ++repeat)
+	{
+		auto start = std::chrono::steady_clock::now();
+		volatile double checksum = lookup(table,indices);
+		(void)checksum;
+		best = std::max(best,indices.size()/(milliseconds(start)*1e3));
+	}
+	return best;
+}
+
+int main(int argc, char ** argv)
+{
+	int maxLength = (argc > 1) ? std::stoi(argv[1]) : 13;
+	size_t nLookups = (argc > 2) ? std::stoull(argv[2]) : 1<<24;
+
+	std::mt19937_64 rng(1);
+	std::vector<uint64_t> random(nLookups);
+	for (auto & r : random)
+	{
+		r = rng();
+	}
+
+	std::cout << nLookups << " random lookups per table\n\n";
+	std::cout << std::setw(4) << "L" << std::setw(14) << "table (MiB)" << std::setw(14) << "vector fill" << std::setw(16) << "standard fill" << std::setw(12) << "huge fill" << std::setw(18) << "standard (M/s)" << std::setw(14) << "huge (M/s)" << "   backing\n";
+	std::cout << std::fixed << std::setprecision(1);
+	for (int L = 9; L <= maxLength; ++L)
+	{
+		const size_t n = static_cast<size_t>(1) << (Sequence::LogAlphabetSize * L);
+		std::vector<uint64_t> indices(nLookups);
+		for (size_t i = 0; i < nLookups; ++i)
+		{
+			indices[i] = random[i] & (n - 1);
+		}
+
+		double vectorFill;
+		{
+			auto start = std::chrono::steady_clock::now();
+			std::vector<PrecomputeElement> table(n);
+			write(table,0,n);
+			vectorFill = milliseconds(start);
+		}
+
+		double fills[2];
+		double rates[2];
+		std::string backing;
+		for (int huge = 0; huge < 2; ++huge)
+		{
+			auto start = std::chrono::steady_clock::now();
+			HugePageArray<PrecomputeElement> table;
+			table.Allocate(n,huge);
+			for (size_t tile = 0; tile < n; tile += PrecomputeTileSize)
+			{
+				size_t end = std::min(n,tile + PrecomputeTileSize);
+				std::fill(&table[tile],&table[end],PrecomputeElement());
+				write(table,tile,end);
+			}
+			fills[huge] = milliseconds(start);
+			rates[huge] = lookupRate(table,indices);
+			if (huge)
+			{
+				backing = std::string(HugePageBuffer::Name(table.Kind())) + ", " + std::to_string(table.HugeBytes() >> 20) + " MiB obtained";
+			}
+		}
+
+		std::cout << std::setw(4) << L << std::setw(14) << (n*sizeof(PrecomputeElement))/double(1<<20) << std::setw(11) << vectorFill << " ms" << std::setw(13) << fills[0] << " ms" << std::setw(9) << fills[1] << " ms" << std::setw(18) << rates[0] << std::setw(14) << rates[1] << "   " << backing << "\n";
+	}
+}
@@ -0,0 +1,159 @@
+/*
+	Measures the rate of precomputed-table lookups (lookups per second) against the table size: made directly, with prefetching ahead of use, and sorted by address.
+
+	The reads are random 40-mers, held in transposed batches (see Sequence::ReadBatch), and each batch is swept exactly as in SequenceScanner::SweepBatch: a rolling code per read, one lookup per read per position. With prefetching, a second window runs PrefetchDistance positions ahead and prefetches the entries it will need. In sorted mode (-sorted-lookups) the lookups of each block of RecordTile reads are collected, sorted by table page (see SortedLookups), and then made.
+
+	Build with 'make benchmark', and run .build/bench/lookupBenchmark [max length] [reads]
+*/
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include <bit>
+#include "../src/scan/SequenceScanner.h"
+#include "../src/scan/fastqReader.h"
+
+typedef dnabits LaneCodes __attribute__((vector_size(Sequence::BatchLanes*sizeof(dnabits))));
+
+LaneCodes baseRow(const Sequence::ReadBatch & batch, int position)
+{
+	LaneCodes base;
+	for (int lane = 0; lane < Sequence::BatchLanes; ++lane)
+	{
+		base[lane] = batch.Bases[position*Sequence::BatchLanes + lane];
+	}
+	return base;
+}
+
+//sweeps every batch, looking up the table entry of every L-mer, and returns a checksum (so that the lookups cannot be optimised away)
+double sweep(const std::vector<PrecomputeElement> & table, const std::vector<Sequence::ReadBatch> & batches, int L, int distance)
+{
+	const dnabits mask = (static_cast<dnabits>(1) << (Sequence::LogAlphabetSize * L)) - 1;
+	double checksum = 0;
+	for (auto & batch : batches)
+	{
+		LaneCodes window = {};
+		LaneCodes ahead = {};
+		for (int position = 0; position < std::min(distance,batch.MaxLength); ++position)
+		{
+			ahead = ((ahead << Sequence::LogAlphabetSize) | baseRow(batch,position)) & mask;
+		}
+		for (int end = 0; end < batch.MaxLength; ++end)
+		{
+			window = ((window << Sequence::LogAlphabetSize) | baseRow(batch,end)) & mask;
+			if (distance > 0 && end + distance < batch.MaxLength)
+			{
+				ahead = ((ahead << Sequence::LogAlphabetSize) | baseRow(batch,end + distance)) & mask;
+				for (int lane = 0; lane < batch.Size; ++lane)
+				{
+					__builtin_prefetch(&table[ahead[lane]]);
+				}
+			}
+			if (end + 1 >= L)
+			{
+				for (int lane = 0; lane < batch.Size; ++lane)
+				{
+					checksum += table[window[lane]].Score;
+				}
+			}
+		}
+	}
+	return checksum;
+}
+
+//as sweep(), but the lookups of each block are collected and made in page order
+double sortedSweep(const std::vector<PrecomputeElement> & table, const std::vector<Sequence::ReadBatch> & batches, int L)
+{
+	const dnabits mask = (static_cast<dnabits>(1) << (Sequence::LogAlphabetSize * L)) - 1;
+	const int blockBatches = RecordTile / Sequence::BatchLanes;
+	const int pageShift = std::bit_width(SortedLookupPageSize / sizeof(PrecomputeElement)) - 1;
+	SortedLookups lookups;
+	std::vector<double> perRead(RecordTile);
+	double checksum = 0;
+	for (size_t first = 0; first < batches.size(); first += blockBatches)
+	{
+		lookups.Clear();
+		size_t last = std::min(batches.size(),first + blockBatches);
+		for (size_t b = first; b < last; ++b)
+		{
+			auto & batch = batches[b];
+			LaneCodes window = {};
+			for (int end = 0; end < batch.MaxLength; ++end)
+			{
+				window = ((window << Sequence::LogAlphabetSize) | baseRow(batch,end)) & mask;
+				if (end + 1 >= L)
+				{
+					for (int lane = 0; lane < batch.Size; ++lane)
+					{
+						lookups.Add(window[lane],(b - first)*Sequence::BatchLanes + lane,end + 1 - L,false);
+					}
+				}
+			}
+		}
+		lookups.Sort(pageShift,Sequence::LogAlphabetSize * L);
+		lookups.ForEach([&](uint32_t index, uint32_t read, int, bool){
+			perRead[read] += table[index].Score;
+		});
+	}
+	for (double sum : perRead)
+	{
+		checksum += sum;
+	}
+	return checksum;
+}
+
+int main(int argc, char ** argv)
+{
+	const int maxLength = (argc > 1) ? std::stoi(argv[1]) : 13;
+	const int nReads = (argc > 2) ? std::stoi(argv[2]) : 1<<20;
+	const int readLength = 40;
+
+	std::mt19937_64 rng(1);
+	std::vector<Sequence::ReadBatch> batches(nReads/Sequence::BatchLanes);
+	std::vector<std::string> reads(nReads,std::string(readLength,'A'));
+	for (size_t b = 0; b < batches.size(); ++b)
+	{
+		for (int lane = 0; lane < Sequence::BatchLanes; ++lane)
+		{
+			auto & read = reads[b*Sequence::BatchLanes + lane];
+			for (auto & c : read)
+			{
+				c = "ACGT"[rng() & 3];
+			}
+			batches[b].Add(read);
+		}
+	}
+
+	std::cout << "PrefetchDistance = " << PrefetchDistance << ", " << batches.size() * Sequence::BatchLanes << " reads of length " << readLength << "\n\n";
+	std::cout << std::setw(4) << "L" << std::setw(14) << "table (MiB)" << std::setw(20) << "direct (M/s)" << std::setw(20) << "prefetched (M/s)" << std::setw(20) << "sorted (M/s)" << "\n";
+	for (int L = 6; L <= maxLength; ++L)
+	{
+		std::vector<PrecomputeElement> table(static_cast<size_t>(1) << (Sequence::LogAlphabetSize * L));
+		std::uniform_real_distribution<float> score(-1,1);
+		for (auto & element : table)
+		{
+			element.Score = score(rng);
+		}
+
+		double lookups = static_cast<double>(batches.size()) * Sequence::BatchLanes * (readLength - L + 1);
+		double rates[3];
+		int distances[2] = {0,PrefetchDistance};
+		for (int k = 0; k < 3; ++k)
+		{
+			//the best of a few repeats
+			double best = 0;
+			for (int repeat = 0; repeat < 3; ++repeat)
+			{
+				auto start = std::chrono::steady_clock::now();
+				volatile double checksum = (k < 2) ? sweep(table,batches,L,distances[k]) : sortedSweep(table,batches,L);
+				(void)checksum;
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+				best = std::max(best,lookups/elapsed.count()/1e6);
+			}
+			rates[k] = best;
+		}
+		std::cout << std::setw(4) << L << std::setw(14) << std::fixed << std::setprecision(2) << table.size() * sizeof(PrecomputeElement) / (1024.0*1024.0) << std::setw(20) << std::setprecision(1) << rates[0] << std::setw(20) << rates[1] << std::setw(20) << rates[2] << "\n";
+	}
+	return 0;
+}
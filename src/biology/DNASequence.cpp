@@ -1,9 +1,18 @@
 #include "DNASequence.h"
+#include <algorithm>
 
 namespace Sequence
 {
 	//used for the bitfields to efficiently encode dna strings
-	
+	const std::array<unsigned char,256> BaseCode = []{
+		std::array<unsigned char,256> codes;
+		codes.fill(InvalidBase);
+		codes['A'] = codes['a'] = 0;
+		codes['C'] = codes['c'] = 1;
+		codes['G'] = codes['g'] = 2;
+		codes['T'] = codes['t'] = 3;
+		return codes;
+	}();
 
 	DNA::DNA(std::string_view sequencestring) //: Length(sequencestring.size())
 	{
@@ -24,26 +33,15 @@ namespace Sequence
 			// SequenceString.resize(Length,' ');
 			Sequence.resize(Length,0);
 		}
-		int i = 0;
-		for (char c : sequence)
+		//a table lookup, rather than a switch, since the branches of a switch on random bases are unpredictable
+		unsigned char invalid = 0;
+		for (int i = 0; i < Length; ++i)
 		{
-			// SequenceString[i] = c;
-			switch (c) 
-			{
-				case 'A': case 'a': Sequence[i] = 0; break;
-				case 'C': case 'c': Sequence[i] = 1; break;
-				case 'G': case 'g': Sequence[i] = 2; break;
-				case 'T': case 't': Sequence[i] = 3; break;
-				default:
-					// LOG(ERROR) << "Character " << c << " in sequence " << sequence << " is not a part of the DNA library";
-					// throw std::runtime_error("Invalid DNA sequence");
-					AlphabetContained = false;
-					return;
-					break;
-			}
-			++i;
+			unsigned char code = BaseCode[(unsigned char)sequence[i]];
+			Sequence[i] = code & BitHackExtractor;
+			invalid |= code;
 		}
-		AlphabetContained = true;
+		AlphabetContained = (invalid & InvalidBase) == 0;
 	}
 
 	void DNA::SetBitfield(size_t motifSize, int startIdx )
@@ -102,4 +100,78 @@ namespace Sequence
 		}
 		return out;
 	}
-}
\ No newline at end of file
+
+	bool ReadBatch::Add(std::string_view sequence)
+	{
+		int length = sequence.size();
+		if (Bases.size() < static_cast<size_t>(length) * BatchLanes)
+		{
+			Bases.resize(static_cast<size_t>(length) * BatchLanes,0);
+		}
+		unsigned char invalid = 0;
+		for (int p = 0; p < length; ++p)
+		{
+			unsigned char code = BaseCode[(unsigned char)sequence[p]];
+			Bases[p*BatchLanes + Size] = code & BitHackExtractor;
+			invalid |= code;
+		}
+		if (invalid & InvalidBase)
+		{
+			return false;
+		}
+		Lengths[Size] = length;
+		Sequences[Size] = sequence;
+		MaxLength = std::max(MaxLength,length);
+		++Size;
+		return true;
+	}
+
+	//the reverse complement of a centre of the given width (in bases)
+	int centreComplement(int centre, int width)
+	{
+		int rc = 0;
+		for (int i = 0; i < width; ++i)
+		{
+			rc = (rc << LogAlphabetSize) + ((centre & BitHackExtractor) ^ BitHackExtractor);
+			centre = centre >> LogAlphabetSize;
+		}
+		return rc;
+	}
+
+	CanonicalIndexer::CanonicalIndexer(int length) : Length(length)
+	{
+		int centreWidth = (length % 2 == 0) ? 2 : 1;
+		int flankWidth = (length - centreWidth)/2;
+		RightBits = LogAlphabetSize * flankWidth;
+		LeftShift = RightBits + LogAlphabetSize * centreWidth;
+		RightMask = (static_cast<dnabits>(1) << RightBits) - 1;
+		CentreMask = (1 << (LogAlphabetSize * centreWidth)) - 1;
+
+		//of each pair of partner centres, the smaller is kept; self-complementary centres are kept as-is
+		NSlots = 0;
+		for (int centre = 0; centre <= (int)CentreMask; ++centre)
+		{
+			int partner = centreComplement(centre,centreWidth);
+			Flip[centre] = partner < centre;
+			Slot[centre] = -1;
+			if (!Flip[centre])
+			{
+				Slot[centre] = NSlots;
+				SlotCentre[NSlots] = centre;
+				++NSlots;
+			}
+		}
+	}
+
+	size_t CanonicalIndexer::Size() const
+	{
+		return (static_cast<size_t>(1) << (LogAlphabetSize * Length - (LeftShift - RightBits))) * NSlots;
+	}
+
+	dnabits CanonicalIndexer::Code(size_t index) const
+	{
+		dnabits outer = index / NSlots;
+		dnabits centre = SlotCentre[index % NSlots];
+		return ((outer >> RightBits) << LeftShift) | (centre << RightBits) | (outer & RightMask);
+	}
+}
@@ -1,14 +1,20 @@
 #pragma once
 #include <string_view>
 #include <vector>
+#include <array>
 #include "../tools/Log.h"
 typedef uint_fast32_t dnabits;
+typedef int32_t fixedscore; //a motif score measured in integer steps of the quantisation resolution (see MotifMatrix::Quantise)
 
 
 namespace Sequence
 {
 	const int LogAlphabetSize = 2;
 	const int BitHackExtractor = 3;
+
+	//! The 0/1/2/3 encoding of each character (A/C/G/T, either case); all other characters map to InvalidBase
+	extern const std::array<unsigned char,256> BaseCode;
+	const unsigned char InvalidBase = 4;
 	class DNA
 	{
 		public:
@@ -57,4 +63,73 @@ namespace Sequence
 
 
 	std::string Decode(dnabits code, size_t length);
+
+	const int BatchLanes = 16; //the number of reads held by a ReadBatch
+
+	/*!
+		@brief Up to BatchLanes reads, encoded as in DNA, and transposed so that each position holds one base from every read
+		@details Lane i holds read i: base p of read i is Bases[p*BatchLanes + i]. Positions beyond the end of a read (and lanes beyond Size) hold stale but valid bases, and must be masked off by Lengths.
+	*/
+	class ReadBatch
+	{
+		public:
+			ReadBatch(){Clear();};
+
+			int Size;
+			int MaxLength; //!< The length of the longest read in the batch
+			int Lengths[BatchLanes];
+			std::string_view Sequences[BatchLanes];
+			std::vector<unsigned char> Bases;
+
+			//! Empties the batch; the storage is kept for reuse
+			void Clear(){Size = 0; MaxLength = 0;};
+
+			//! Encodes a read into the next lane. Returns false (and leaves the batch unchanged) if it contains a character outside the DNA alphabet
+			bool Add(std::string_view sequence);
+			bool Full() const {return Size == BatchLanes;};
+	};
+
+	/*!
+		@brief Maps L-mer codes onto a table which holds only one of each reverse-complement pair
+		@details An L-mer is split into a centre (the middle base for odd L, the middle two for even L) and the flanks either side. Reverse complementing swaps and complements the flanks and maps each centre onto a partner centre: of each such pair only one centre is kept, and codes with the other centre are looked up via their reverse complement (and are reported as 'flipped'). 
+
+		For odd L no centre is its own partner, so the table holds exactly 4^L/2 entries. For even L the four self-complementary centre pairs (AT, CG, GC, TA) must be stored in both orientations, so the table holds 10/16 of 4^L entries.
+	*/
+	class CanonicalIndexer
+	{
+		public:
+			CanonicalIndexer(int length);
+
+			//! The number of table entries required
+			size_t Size() const;
+
+			//! The L-mer (in its canonical orientation) held at a given table index
+			dnabits Code(size_t index) const;
+
+			//! The number of distinct centres held, which form the fastest-varying part of the index
+			int Slots() const {return NSlots;};
+
+			//! The number of bases either side of the centre. The final bases of the right-hand flank form the next-fastest-varying part of the index.
+			int FlankWidth() const {return RightBits/LogAlphabetSize;};
+
+			//! The table index of an L-mer, given its code and the code of its reverse complement. flipped is set to true if the entry is held for the reverse complement.
+			inline size_t Index(dnabits code, dnabits rcCode, bool & flipped) const
+			{
+				int centre = (code >> RightBits) & CentreMask;
+				flipped = Flip[centre];
+				dnabits canonical = flipped ? rcCode : code;
+				dnabits outer = ((canonical >> LeftShift) << RightBits) | (canonical & RightMask);
+				return outer * NSlots + Slot[(canonical >> RightBits) & CentreMask];
+			};
+		private:
+			int Length;
+			int NSlots;
+			int RightBits;
+			int LeftShift;
+			dnabits RightMask;
+			dnabits CentreMask;
+			int8_t Slot[16];
+			bool Flip[16];
+			int SlotCentre[16];
+	};
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "MotifMatrix.h"
 #include <iomanip>
 #include <cmath>
+#include <limits>
+#include <algorithm>
 #include "../tools/fileparser.h"
 MotifMatrix::MotifMatrix(std::string filepath,int id) : ID(id)
 {
@@ -60,6 +62,11 @@ MotifMatrix::MotifMatrix(std::string filepath,int id) : ID(id)
 		}
 	}
 	MotifLength = LogOdds.size();
+	MaximumSum = 0;
+	for (auto & column : LogOdds)
+	{
+		MaximumSum += *std::max_element(column.begin(),column.end());
+	}
 }
 size_t MotifMatrix::size() const
 {
@@ -84,6 +91,52 @@ std::pair<double,double> MotifMatrix::Score(Sequence::DNA & sequence, int idx) c
 	return {forwardScore/L,rcScore/L};
 }
 
+void MotifMatrix::Quantise(double resolution)
+{
+	const int L = MotifLength;
+	const fixedscore limit = std::numeric_limits<int16_t>::max()/L;
+	QuantisedLogOdds.resize(4*L);
+	int clamped = 0;
+	for (int i = 0; i < L; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			double steps = std::round(LogOdds[i][j]/(L*resolution));
+			if (std::abs(steps) > limit)
+			{
+				clamped += std::isfinite(steps);
+				steps = std::copysign(limit,steps);
+			}
+			QuantisedLogOdds[4*i+j] = steps;
+		}
+	}
+	QuantisedMaximumSum = 0;
+	for (int i = 0; i < L; ++i)
+	{
+		const fixedscore * column = &QuantisedLogOdds[4*i];
+		QuantisedMaximumSum += *std::max_element(column,column+4);
+	}
+	if (clamped > 0)
+	{
+		LOG(WARN) << "Motif " << ID << " had " << clamped << " log-odds clamped to fit the int16 score range; the resolution " << resolution << " is too fine for a motif of length " << L;
+	}
+}
+
+double MotifMatrix::MaximumScore() const
+{
+	return MaximumSum/MotifLength;
+}
+
+fixedscore MotifMatrix::MaximumQuantisedScore() const
+{
+	return QuantisedMaximumSum;
+}
+
+const std::vector<fixedscore> & MotifMatrix::ReferenceQuantisedScores() const
+{
+	return QuantisedLogOdds;
+}
+
 std::string MotifMatrix::ToString() const
 {
 	std::stringstream s;
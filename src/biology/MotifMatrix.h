@@ -16,9 +16,29 @@ class MotifMatrix
 		std::vector<std::vector<double>> LogOdds;
 		const int ID;
 		std::pair<double,double> Score(Sequence::DNA & sequence, int idx) const;
+
+		//! The score of the consensus sequence: no k-mer can score higher on either strand
+		double MaximumScore() const;
+
+		//! The fixed-point analogue of MaximumScore(). Requires Quantise() to have been called
+		fixedscore MaximumQuantisedScore() const;
 		const std::vector<std::vector<double>> & ReferenceScores() const;
+
+		/*!
+			@brief Computes the fixed-point log-odds used when scores are quantised (see -quantise)
+			@details Each log-odd is divided by the motif length (so that summing them gives the mean log-odd, as with Score()) and rounded to the nearest multiple of resolution. Values are clamped to +/- (2^15-1)/L, so that the score of any L-mer fits in an int16 table entry; this is only reached by very fine resolutions, or by log(0) entries in the PFM.
+		*/
+		void Quantise(double resolution);
+
+		//! Quantised log-odds, indexed [position * 4 + base]. Empty unless Quantise() has been called
+		const std::vector<fixedscore> & ReferenceQuantisedScores() const;
 	private:
 		size_t MotifLength;
+		std::vector<fixedscore> QuantisedLogOdds;
+
+		//the sums of the column maxima, from which MaximumScore() and MaximumQuantisedScore() are read
+		double MaximumSum;
+		fixedscore QuantisedMaximumSum;
 		// void PrecomputeScores();
 		// std::vector<double> PrecomputedScores;
 };
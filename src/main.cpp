@@ -11,6 +11,7 @@
 #include "parallel/parallel.h"
 #include "scan/fastqReader.h"
 #include <mutex>
+#include <sstream>
 
 namespace fs = std::filesystem;
 
@@ -34,23 +35,46 @@ void scanSeq()
 {
 
 	
+	ParallelPool Parallel(Settings.System.ParallelThreads,Settings.System.PinThreads);
+
 	auto pwm = getRecursiveFileList(Settings.Input.PFMDirectory,Settings.Input.PFMRegex);
-	auto scanner = SequenceScanner(pwm);
 
 	const fs::path inputRoot(Settings.Input.ReadDirectory.Value());
 	const fs::path outputRoot(Settings.Output.OutputDirectory.Value());
 	auto fastqFiles = getRecursiveFileList(inputRoot,Settings.Input.ReadRegex);
 	// fastqFiles.resize(15);
-	
-	
-	ParallelPool Parallel(Settings.System.ParallelThreads);
+
+	//the precomputation is planned for the input actually present, rather than the -estimate-count and -estimate-length guesses
+	InputEstimate input = InputEstimate::FromSettings();
+	if (Settings.Input.InputSample > 0 && fastqFiles.size() > 0)
+	{
+		input = sampleInput(fastqFiles,Settings.Input.InputSample * 1024 * 1024,Parallel);
+	}
+	std::ostringstream estimate;
+	input.Print(estimate);
+	LOG(INFO) << estimate.str();
+
+	SequenceScanner scanner(pwm,Parallel,input);
+	if (Settings.System.PlanOnly)
+	{
+		LOG(INFO) << "Precomputation plan printed; not scanning";
+		return;
+	}
+
 
 	std::atomic<int> globalCount;
 	std::mutex lock;
 
 	
+	//if there are fewer files than threads, parallelising over files would leave threads idle, so instead go through the files one at a time, and parallelise within each file
+	bool intraFile = fastqFiles.size() < Settings.System.ParallelThreads;
+	if (intraFile)
+	{
+		LOG(INFO) << "Fewer files than threads: parallelising within each file";
+	}
+
 	ProgressBar PB(fastqFiles.size(),"Iterating through " +std::to_string(fastqFiles.size()) + " files\n");
-	Parallel.For(fastqFiles.size(),[&](int i)
+	auto scanFile = [&](int i)
 	{
 		++globalCount;
 		lock.lock();
@@ -64,15 +88,41 @@ void scanSeq()
 		std::ofstream outstream(outname);
 		if (extension == ".gz")
 		{
-			gzfastQScan(fastqFiles[i].path().string(),scanner,outstream);
+			if (intraFile)
+			{
+				parallelGzfastQScan(fastqFiles[i].path().string(),scanner,outstream,Parallel);
+			}
+			else
+			{
+				gzfastQScan(fastqFiles[i].path().string(),scanner,outstream);
+			}
 		}
 		else
 		{
-			fastqScan(fastqFiles[i].path().string(),scanner,outstream);
+			if (intraFile)
+			{
+				parallelFastqScan(fastqFiles[i].path().string(),scanner,outstream,Parallel);
+			}
+			else
+			{
+				fastqScan(fastqFiles[i].path().string(),scanner,outstream);
+			}
 		}
 		outstream.close();
 
-	});
+	};
+	if (intraFile)
+	{
+		for (size_t i = 0; i < fastqFiles.size(); ++i)
+		{
+			scanFile(i);
+		}
+	}
+	else
+	{
+		Parallel.For(fastqFiles.size(),scanFile);
+	}
+	scanner.ReportMemo();
 	LOG(INFO) << "Scan complete, exiting scope";
 }
 
@@ -0,0 +1,159 @@
+#include "numa.h"
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "../tools/Log.h"
+
+namespace
+{
+	//the memory policies of mbind(2), from linux/mempolicy.h
+	const int PolicyBind = 2;
+	const int PolicyInterleave = 3;
+	const unsigned MoveFlag = 1<<1;
+
+	thread_local int CurrentNode = 0;
+
+	//parses a kernel CPU/node list such as "0-3,8-11"
+	std::vector<int> parseList(const std::string & list)
+	{
+		std::vector<int> values;
+		size_t start = 0;
+		while (start < list.size())
+		{
+			size_t end = list.find(',',start);
+			if (end == std::string::npos)
+			{
+				end = list.size();
+			}
+			std::string range = list.substr(start,end-start);
+			size_t dash = range.find('-');
+			if (!range.empty() && range.find_first_not_of("0123456789-\n") == std::string::npos)
+			{
+				int low = std::stoi(range.substr(0,dash));
+				int high = (dash == std::string::npos) ? low : std::stoi(range.substr(dash+1));
+				for (int v = low; v <= high; ++v)
+				{
+					values.push_back(v);
+				}
+			}
+			start = end + 1;
+		}
+		return values;
+	}
+
+	std::string readLine(const std::string & file)
+	{
+		std::ifstream stream(file);
+		std::string line;
+		std::getline(stream,line);
+		return line;
+	}
+
+	std::vector<NumaNode> discoverNodes()
+	{
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		bool haveAffinity = (sched_getaffinity(0,sizeof(allowed),&allowed) == 0);
+		auto available = [&](int cpu){
+			return !haveAffinity || (cpu < CPU_SETSIZE && CPU_ISSET(cpu,&allowed));
+		};
+
+		std::vector<NumaNode> nodes;
+		const std::string root = "/sys/devices/system/node/";
+		for (int id : parseList(readLine(root + "online")))
+		{
+			NumaNode node{id,{}};
+			for (int cpu : parseList(readLine(root + "node" + std::to_string(id) + "/cpulist")))
+			{
+				if (available(cpu))
+				{
+					node.CPUs.push_back(cpu);
+				}
+			}
+			//memory-only nodes (and nodes we may not run on) cannot hold a thread's local replica
+			if (!node.CPUs.empty())
+			{
+				nodes.push_back(node);
+			}
+		}
+
+		if (nodes.empty())
+		{
+			NumaNode node{0,{}};
+			for (int cpu = 0; cpu < (int)std::max(1u,std::thread::hardware_concurrency()); ++cpu)
+			{
+				if (available(cpu))
+				{
+					node.CPUs.push_back(cpu);
+				}
+			}
+			nodes.push_back(node);
+		}
+		return nodes;
+	}
+
+	bool setPolicy(void * start, size_t bytes, int mode, const std::vector<int> & nodeIDs, unsigned flags)
+	{
+		const int bitsPerWord = 8*sizeof(unsigned long);
+		int maxID = 0;
+		for (int id : nodeIDs)
+		{
+			maxID = std::max(maxID,id);
+		}
+		std::vector<unsigned long> mask(maxID/bitsPerWord + 1,0);
+		for (int id : nodeIDs)
+		{
+			mask[id/bitsPerWord] |= 1ul << (id % bitsPerWord);
+		}
+		return syscall(SYS_mbind,start,bytes,mode,mask.data(),mask.size()*bitsPerWord + 1,flags) == 0;
+	}
+}
+
+const std::vector<NumaNode> & numaNodes()
+{
+	static const std::vector<NumaNode> nodes = discoverNodes();
+	return nodes;
+}
+
+void pinThread(int slot)
+{
+	auto & nodes = numaNodes();
+	int node = slot % nodes.size();
+	auto & cpus = nodes[node].CPUs;
+	int cpu = cpus[(slot / nodes.size()) % cpus.size()];
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu,&set);
+	if (pthread_setaffinity_np(pthread_self(),sizeof(set),&set) != 0)
+	{
+		LOG(WARN) << "Could not pin thread " << slot << " to CPU " << cpu;
+		return;
+	}
+	CurrentNode = node;
+}
+
+int numaNode()
+{
+	return CurrentNode;
+}
+
+bool bindMemory(void * start, size_t bytes, int node, bool move)
+{
+	return setPolicy(start,bytes,PolicyBind,{numaNodes()[node].ID},move ? MoveFlag : 0);
+}
+
+bool interleaveMemory(void * start, size_t bytes)
+{
+	std::vector<int> ids;
+	for (auto & node : numaNodes())
+	{
+		ids.push_back(node.ID);
+	}
+	return setPolicy(start,bytes,PolicyInterleave,ids,0);
+}
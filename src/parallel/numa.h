@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+/*!
+	@brief A NUMA node, and the CPUs of it on which this process may run
+*/
+struct NumaNode
+{
+	int ID; //!< The kernel's number for the node
+	std::vector<int> CPUs;
+};
+
+/*!
+	@brief The NUMA nodes of the machine which have CPUs available to this process, read once from /sys/devices/system/node
+	@details On systems without NUMA information (or with a single node), this is a single node holding every available CPU.
+*/
+const std::vector<NumaNode> & numaNodes();
+
+/*!
+	@brief Pins the calling thread to the CPU of the given slot, and records its node (see numaNode())
+	@details Slots are dealt out to the nodes in turn, and then to the CPUs within each node, so that any number of threads is spread as evenly as possible over the nodes.
+*/
+void pinThread(int slot);
+
+//! The index (into numaNodes()) of the node to which the calling thread is pinned, or 0 if it is not pinned
+int numaNode();
+
+/*!
+	@brief Sets the memory policy of a range of memory, which must begin on a page boundary
+	@details Pages already touched are moved if move is true; otherwise the policy applies only to pages touched later.
+	@returns False if the kernel refused (e.g. it does not support NUMA), in which case the memory is left where the kernel puts it
+*/
+bool bindMemory(void * start, size_t bytes, int node, bool move);
+
+//! As bindMemory(), but spreads the pages over all of numaNodes() in turn
+bool interleaveMemory(void * start, size_t bytes);
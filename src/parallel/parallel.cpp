@@ -1,6 +1,6 @@
 #include "parallel.h"
 
-ParallelPool::ParallelPool(size_t nCores)
+ParallelPool::ParallelPool(size_t nCores, bool pin) : Pinned(pin)
 {
 	InterleavingWarning = true;
 	if (nCores == 0 || nCores > 300)
@@ -8,6 +8,10 @@ ParallelPool::ParallelPool(size_t nCores)
 		throw std::runtime_error("You must request a number of cores between 1 and 300. The main thread counts amongst these cores.");
 	} 
 	StopWorkers = false;
+	if (Pinned)
+	{
+		pinThread(0);
+	}
 	int nWorkers = nCores -1;
 	Workers.reserve(nWorkers);
 	for (int i = 0; i < nWorkers; ++i)
@@ -39,6 +43,10 @@ void ParallelPool::Dispatch(std::function<void()> task) {
 }
 
 void ParallelPool::WorkerMain(int workerID) {
+	if (Pinned)
+	{
+		pinThread(workerID + 1);
+	}
 	while (true) {
 		std::function<void()> task; // Holder for the task
 		{
@@ -9,6 +9,7 @@
 #include <future>
 #include "../tools/Log.h"
 #include "referenceTesters.h"
+#include "numa.h"
 //!Alias for a complex compile-time type. If the function is a void-returning-callable, returns void, else returns std::vector<ReturnType>.
 //!T_Args are included in case T_LoopBodyCallable is itself a template function with a conditional return type; ridiculous futureproofing, but we're here now.
 template<class T_LoopBodyCallable, class... T_Args>
@@ -39,6 +40,7 @@ class ParallelPool
         std::condition_variable ThreadSynchroniser;
 
         bool StopWorkers; // the final end condition
+        bool Pinned; // if true, each worker pins itself before taking any tasks
         
         // The main loop executed by each dedicated worker thread
         void WorkerMain(int workerID);
@@ -134,9 +136,25 @@ class ParallelPool
     public:
         bool InterleavingWarning;
 
-        ParallelPool(size_t nCores);
+        //! True if the threads are pinned to cores, so that numaNode() reports where each runs
+        bool IsPinned() const
+        {
+            return Pinned;
+        }
+
+        /*!
+            @param nCores The total number of threads, including the main thread
+            @param pin If true, every thread (the main thread in slot 0, worker i in slot i+1) is pinned to its own core, spread evenly over the NUMA nodes (see pinThread())
+        */
+        ParallelPool(size_t nCores, bool pin = false);
         ~ParallelPool();
 
+        //! The total number of threads available to a For loop (the workers, plus the main thread)
+        size_t Size() const
+        {
+            return Workers.size() + 1;
+        }
+
         void Synchronise()
         {
              // Notify in case the main thread was the last one and something is waiting (unlikely here, but good practice)
@@ -0,0 +1,75 @@
+#include "FlierMemo.h"
+#include <bit>
+#include <algorithm>
+
+namespace
+{
+	const uint8_t Occupied = 1;
+	const uint8_t Referenced = 2;
+}
+
+FlierMemo::FlierMemo(size_t bytes) : Hits(0), Misses(0), Hand(0)
+{
+	size_t count = std::bit_floor(std::max(bytes/sizeof(Slot),(size_t)ProbeLength));
+	Slots.assign(count,Slot{0,{0,0,0,0},0,0});
+	Mask = count - 1;
+}
+
+size_t FlierMemo::Home(dnabits code, int group) const
+{
+	//a multiplicative hash: the high bits of the product depend on every bit of the key
+	uint64_t key = (code ^ (static_cast<uint64_t>(group) << 58)) * 0x9E3779B97F4A7C15ull;
+	return (key >> 32) & Mask;
+}
+
+bool FlierMemo::Find(dnabits code, int group, MemoResult & out)
+{
+	size_t home = Home(code,group);
+	for (int k = 0; k < ProbeLength; ++k)
+	{
+		Slot & slot = Slots[(home + k) & Mask];
+		if (!(slot.Flags & Occupied))
+		{
+			break;
+		}
+		if (slot.Code == code && slot.Group == group)
+		{
+			slot.Flags |= Referenced;
+			out = slot.Result;
+			++Hits;
+			return true;
+		}
+	}
+	++Misses;
+	return false;
+}
+
+void FlierMemo::Insert(dnabits code, int group, const MemoResult & result)
+{
+	size_t home = Home(code,group);
+	Slot * victim = nullptr;
+	for (int k = 0; k < ProbeLength && !victim; ++k)
+	{
+		Slot & slot = Slots[(home + k) & Mask];
+		if (!(slot.Flags & Occupied))
+		{
+			victim = &slot;
+		}
+	}
+
+	//the window is full: the hand sweeps it (at most twice round), clearing reference bits until it finds an entry which has not been used since it last passed
+	for (int sweep = 0; sweep < 2*ProbeLength && !victim; ++sweep)
+	{
+		Slot & slot = Slots[(home + Hand) & Mask];
+		Hand = (Hand + 1) % ProbeLength;
+		if (slot.Flags & Referenced)
+		{
+			slot.Flags &= ~Referenced;
+		}
+		else
+		{
+			victim = &slot;
+		}
+	}
+	*victim = Slot{code,result,static_cast<uint8_t>(group),Occupied};
+}
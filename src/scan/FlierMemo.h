@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "../biology/DNASequence.h"
+
+/*!
+	@brief The outcome of scoring one k-mer against every on-the-fly motif of a length group, in the form in which it is replayed into a Record
+	@details Score, MotifID and Strand are those of the check which the group's motifs, checked one by one into an empty Record, would have kept; Ties is the number of hits that Record counted. Replaying the winning check Ties times into a read's Record has the same effect as making every check, unless the read's best is itself within the tie tolerance of the group's.
+*/
+struct MemoResult
+{
+	double Score;
+	uint32_t MotifID;
+	uint8_t Strand;
+	uint16_t Ties;
+};
+
+/*!
+	@brief A fixed-size, open-addressed cache of MemoResults, keyed by (length group, k-mer code), with CLOCK eviction
+	@details Each key may live in any of ProbeLength consecutive slots from its hash. Slots are never emptied, only overwritten, so a lookup stops at the first empty slot. When the window of a new key is full, a CLOCK hand sweeps it, giving each referenced entry a second chance (clearing its bit), and evicts the first unreferenced entry. One cache is held per thread, so no synchronisation is needed.
+*/
+class FlierMemo
+{
+	public:
+		//! A cache of (at most) the given size in bytes
+		FlierMemo(size_t bytes);
+
+		//! If the key is cached, copies its result into out and marks it as recently used
+		bool Find(dnabits code, int group, MemoResult & out);
+
+		//! Caches the result of a key which Find() has just missed
+		void Insert(dnabits code, int group, const MemoResult & result);
+
+		size_t Hits;
+		size_t Misses;
+		size_t Capacity() const {return Slots.size();};
+	private:
+		static const int ProbeLength = 8;
+
+		struct Slot
+		{
+			dnabits Code;
+			MemoResult Result;
+			uint8_t Group;
+			uint8_t Flags; //Occupied | Referenced
+		};
+		std::vector<Slot> Slots;
+		size_t Mask;
+		int Hand; //the position of the CLOCK hand within a probe window
+
+		size_t Home(dnabits code, int group) const;
+};
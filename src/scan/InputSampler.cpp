@@ -0,0 +1,227 @@
+#include "InputSampler.h"
+#include "fastqRecords.h"
+#include "../tools/mappedFile.h"
+#include "../tools/gzipReader.h"
+#include "../settings/Settings.h"
+#include <algorithm>
+#include <numeric>
+#include <iomanip>
+
+namespace
+{
+	const int SampleWindows = 8; //the number of places at which an uncompressed file is sampled
+	const size_t SampleTile = 4096; //records are located this many at a time
+
+	//the sample taken from a single file
+	struct FileSample
+	{
+		double Reads = 0;
+		std::vector<double> LengthCounts; //of the sampled reads only
+		bool Exact = false;
+	};
+
+	//locates every record in text (which must begin on a record boundary), adding its length to the sample. Returns the number of records
+	size_t countRecords(std::string_view text, FileSample & sample)
+	{
+		FastqRecordLocator locator;
+		std::vector<FastqRecord> records;
+		size_t position = 0;
+		size_t count = 0;
+		while (position < text.size())
+		{
+			records.clear();
+			position = locator.Locate(text,position,records,SampleTile);
+			for (auto & record : records)
+			{
+				size_t length = record.Sequence.size();
+				if (length >= sample.LengthCounts.size())
+				{
+					sample.LengthCounts.resize(length+1,0);
+				}
+				++sample.LengthCounts[length];
+			}
+			count += records.size();
+		}
+		return count;
+	}
+
+	FileSample samplePlain(const std::string & filename, size_t sampleBytes)
+	{
+		FileSample sample;
+		MappedFile mapping(filename,false);
+		std::string_view text = mapping.Text();
+		if (text.size() <= sampleBytes)
+		{
+			sample.Reads = countRecords(text,sample);
+			sample.Exact = true;
+			return sample;
+		}
+
+		//evenly spaced windows, the first at the start of the file and the last at its end. Since the file is more than SampleWindows windows long, they never overlap
+		const size_t windowBytes = sampleBytes / SampleWindows;
+		size_t bytes = 0;
+		size_t records = 0;
+		for (int w = 0; w < SampleWindows; ++w)
+		{
+			size_t start = (text.size() - windowBytes) * w / (SampleWindows - 1);
+			if (start > 0)
+			{
+				start = findRecordCut(text,start,false);
+				if (start == std::string_view::npos)
+				{
+					continue;
+				}
+			}
+			size_t end = text.size();
+			if (start + windowBytes < text.size())
+			{
+				end = std::min(end,findRecordCut(text,start + windowBytes,false));
+			}
+			records += countRecords(text.substr(start,end - start),sample);
+			bytes += end - start;
+		}
+		sample.Reads = (bytes > 0) ? text.size() * (static_cast<double>(records) / bytes) : 0;
+		return sample;
+	}
+
+	FileSample sampleGzip(const std::string & filename, size_t sampleBytes)
+	{
+		FileSample sample;
+		GzipReader reader(filename);
+		std::string text(sampleBytes,'\0');
+		size_t n = 0;
+		while (n < sampleBytes)
+		{
+			size_t read = reader.Read(text.data() + n,sampleBytes - n);
+			if (read == 0)
+			{
+				break;
+			}
+			n += read;
+		}
+		std::string_view view(text.data(),n);
+		if (n < sampleBytes)
+		{
+			sample.Reads = countRecords(view,sample);
+			sample.Exact = true;
+			return sample;
+		}
+
+		//the sample ends part-way through a record; the compressed bytes consumed are scaled down by the text discarded after the final cut
+		size_t end = findRecordCut(view,n,true);
+		if (end == std::string_view::npos)
+		{
+			LOG(WARN) << "No complete FASTQ record was found in the first " << sampleBytes << " bytes of " << filename << "; it is left out of the estimate of the input size";
+			return sample;
+		}
+		size_t records = countRecords(view.substr(0,end),sample);
+		double compressed = reader.CompressedBytesRead() * (static_cast<double>(end) / n);
+		sample.Reads = std::filesystem::file_size(filename) * (records / compressed);
+		return sample;
+	}
+}
+
+InputEstimate InputEstimate::FromSettings()
+{
+	InputEstimate estimate;
+	estimate.Reads = Settings.Input.EstimatedReadCount;
+	estimate.LengthCounts.assign(Settings.Input.EstimatedReadLength + 1,0);
+	estimate.LengthCounts.back() = estimate.Reads;
+	return estimate;
+}
+
+double InputEstimate::MeanLength() const
+{
+	double total = 0;
+	double weighted = 0;
+	for (size_t length = 0; length < LengthCounts.size(); ++length)
+	{
+		total += LengthCounts[length];
+		weighted += LengthCounts[length] * length;
+	}
+	return (total > 0) ? weighted / total : 0;
+}
+
+size_t InputEstimate::Quantile(double fraction) const
+{
+	double total = std::accumulate(LengthCounts.begin(),LengthCounts.end(),0.0);
+	double running = 0;
+	for (size_t length = 0; length < LengthCounts.size(); ++length)
+	{
+		running += LengthCounts[length];
+		if (running > 0 && running >= fraction * total)
+		{
+			return length;
+		}
+	}
+	return 0;
+}
+
+double InputEstimate::Windows(int L) const
+{
+	double total = 0;
+	double windows = 0;
+	for (size_t length = 0; length < LengthCounts.size(); ++length)
+	{
+		total += LengthCounts[length];
+		windows += LengthCounts[length] * std::max(0,static_cast<int>(length) - L + 1);
+	}
+	return (total > 0) ? windows / total : 0;
+}
+
+void InputEstimate::Print(std::ostream & out) const
+{
+	if (Sampled)
+	{
+		out << "Estimated " << static_cast<size_t>(Reads + 0.5) << " reads in " << Files << " file(s), " << ExactFiles << " of them read completely";
+	}
+	else
+	{
+		out << "Assuming " << static_cast<size_t>(Reads + 0.5) << " reads (see -estimate-count)";
+	}
+	out << "; read lengths: min " << Quantile(0) << ", median " << Quantile(0.5) << ", mean " << std::fixed << std::setprecision(1) << MeanLength() << ", max " << Quantile(1);
+	out.unsetf(std::ios::floatfield);
+}
+
+InputEstimate sampleInput(const std::vector<std::filesystem::directory_entry> & files, size_t sampleBytes, ParallelPool & pool)
+{
+	std::vector<FileSample> samples(files.size());
+	pool.For(files.size(),[&](int i)
+	{
+		std::string filename = files[i].path().string();
+		//as in the scan, files are treated as gzip by their extension
+		if (files[i].path().extension() == ".gz")
+		{
+			samples[i] = sampleGzip(filename,sampleBytes);
+		}
+		else
+		{
+			samples[i] = samplePlain(filename,sampleBytes);
+		}
+	});
+
+	InputEstimate estimate;
+	estimate.Sampled = true;
+	estimate.Files = files.size();
+	for (auto & sample : samples)
+	{
+		double sampled = std::accumulate(sample.LengthCounts.begin(),sample.LengthCounts.end(),0.0);
+		if (sampled == 0)
+		{
+			continue;
+		}
+		estimate.Reads += sample.Reads;
+		estimate.ExactFiles += sample.Exact;
+		if (sample.LengthCounts.size() > estimate.LengthCounts.size())
+		{
+			estimate.LengthCounts.resize(sample.LengthCounts.size(),0);
+		}
+		//each file's lengths are weighted by its share of the reads
+		double scale = sample.Reads / sampled;
+		for (size_t length = 0; length < sample.LengthCounts.size(); ++length)
+		{
+			estimate.LengthCounts[length] += sample.LengthCounts[length] * scale;
+		}
+	}
+	return estimate;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <ostream>
+#include "../parallel/parallel.h"
+
+/*!
+	@brief The (estimated) number of reads which a run will scan, and the distribution of their lengths
+	@details Built either from a sample of the read files (see sampleInput), or from the -estimate-count and -estimate-length settings. The length distribution is held as a histogram (each file's sample scaled up to its estimated count), so that the number of windows of each motif length can be counted exactly for the sample (reads shorter than a motif contribute none) rather than guessed from the mean.
+*/
+struct InputEstimate
+{
+	double Reads = 0; //!< The estimated total number of reads
+	std::vector<double> LengthCounts; //!< The estimated number of reads of each length, across all files
+	size_t Files = 0;
+	size_t ExactFiles = 0; //!< The files which were small enough to be read completely, and so contribute their exact count
+	bool Sampled = false;
+
+	//! An estimate taken from the -estimate-count and -estimate-length settings
+	static InputEstimate FromSettings();
+
+	double MeanLength() const;
+
+	//! The shortest length such that at least this fraction of the reads are no longer
+	size_t Quantile(double fraction) const;
+
+	//! The mean number of windows of length L in each read, i.e. the mean of max(0, length - L + 1)
+	double Windows(int L) const;
+
+	void Print(std::ostream & out) const;
+};
+
+/*!
+	@brief A fast pre-pass over the read files, which estimates the total number of reads and their lengths without scanning them
+	@details From each file up to sampleBytes of FASTQ text is parsed. Uncompressed files are memory-mapped, and sampled at a number of evenly spaced, record-aligned windows, so that files which change along their length (e.g. sorted or concatenated runs) are still represented; files no larger than sampleBytes are parsed completely. Gzip files can only be read from the start, so the first sampleBytes are decompressed, and the count is extrapolated by the number of compressed bytes consumed. The read count of a file is its size times the records found per byte of the sample. Files are sampled in parallel.
+	@param files The read files, as found in the read directory
+	@param sampleBytes The (decompressed) text parsed from each file
+*/
+InputEstimate sampleInput(const std::vector<std::filesystem::directory_entry> & files, size_t sampleBytes, ParallelPool & pool);
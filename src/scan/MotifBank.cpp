@@ -0,0 +1,214 @@
+#include "MotifBank.h"
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+namespace
+{
+	const int PruneInterval = 4; //the bound is only tested every few columns, since a mispredicted exit costs more than the additions it saves
+
+	//the weight of an empty lane: low enough never to reach a threshold, but (for integers) unable to overflow when summed
+	template<class Sum>
+	Sum emptyWeight(int length)
+	{
+		if constexpr (std::is_floating_point_v<Sum>)
+		{
+			return -std::numeric_limits<Sum>::infinity();
+		}
+		else
+		{
+			return std::numeric_limits<Sum>::min()/(2*(length+1));
+		}
+	}
+
+	template<class Sum>
+	struct BankView
+	{
+		const Sum * Forward;
+		const Sum * Reverse;
+		const Sum * ForwardRemaining;
+		const Sum * ReverseRemaining;
+		int Length;
+		int Size;
+		int Stride; //the distance between consecutive bases of the read
+	};
+
+	template<class Sum>
+	using BankKernel = bool (*)(const BankView<Sum> & bank, const unsigned char * bases, Sum threshold, bool prune, Sum * forward, Sum * rc);
+
+	//the body shared by every kernel: W lanes are summed at a time, in vectors of W Sums. Always inlined, so that it is compiled for the instruction set of each kernel
+	template<class Sum, int W>
+	inline __attribute__((always_inline)) bool scoreLanes(const BankView<Sum> & bank, const unsigned char * bases, Sum threshold, bool prune, Sum * forward, Sum * rc)
+	{
+		typedef Sum Vec __attribute__((vector_size(W*sizeof(Sum))));
+		//unaligned loads; no lambdas here, since they would not inherit the kernel's instruction set
+		#define BANK_LOAD(v,data) Vec v; std::memcpy(&v,data,sizeof(Vec));
+
+		const int L = bank.Length;
+		const Vec target = Vec{} + threshold;
+		bool any = false;
+		for (int lane = 0; lane < bank.Size; lane += W)
+		{
+			Vec f = {};
+			Vec r = {};
+			bool abandoned = false;
+			for (int p = 0; p < L; ++p)
+			{
+				size_t offset = (4*p + bases[p*bank.Stride])*BankLanes + lane;
+				BANK_LOAD(fWeights,bank.Forward + offset);
+				BANK_LOAD(rWeights,bank.Reverse + offset);
+				f += fWeights;
+				r += rWeights;
+				if (prune && (p+1) % PruneInterval == 0 && p+1 < L)
+				{
+					BANK_LOAD(fRemaining,bank.ForwardRemaining + (p+1)*BankLanes + lane);
+					BANK_LOAD(rRemaining,bank.ReverseRemaining + (p+1)*BankLanes + lane);
+					Vec fBest = f + fRemaining;
+					Vec rBest = r + rRemaining;
+					auto alive = (fBest >= target) | (rBest >= target);
+					bool anyAlive = false;
+					for (int k = 0; k < W; ++k)
+					{
+						anyAlive |= (alive[k] != 0);
+					}
+					if (!anyAlive)
+					{
+						abandoned = true;
+						break;
+					}
+				}
+			}
+			if (abandoned)
+			{
+				std::fill(forward + lane,forward + lane + W,std::numeric_limits<Sum>::lowest());
+				std::fill(rc + lane,rc + lane + W,std::numeric_limits<Sum>::lowest());
+				continue;
+			}
+			std::memcpy(forward + lane,&f,sizeof(Vec));
+			std::memcpy(rc + lane,&r,sizeof(Vec));
+			auto reached = (f >= target) | (r >= target);
+			for (int k = 0; k < W; ++k)
+			{
+				any |= (reached[k] != 0);
+			}
+		}
+		#undef BANK_LOAD
+		return any;
+	}
+
+	template<class Sum>
+	[[maybe_unused]] bool scoreScalar(const BankView<Sum> & bank, const unsigned char * bases, Sum threshold, bool prune, Sum * forward, Sum * rc)
+	{
+		return scoreLanes<Sum,1>(bank,bases,threshold,prune,forward,rc);
+	}
+
+	#if defined(__x86_64__)
+	template<class Sum>
+	bool scoreSSE2(const BankView<Sum> & bank, const unsigned char * bases, Sum threshold, bool prune, Sum * forward, Sum * rc)
+	{
+		return scoreLanes<Sum,16/sizeof(Sum)>(bank,bases,threshold,prune,forward,rc);
+	}
+
+	template<class Sum>
+	__attribute__((target("avx2"))) bool scoreAVX2(const BankView<Sum> & bank, const unsigned char * bases, Sum threshold, bool prune, Sum * forward, Sum * rc)
+	{
+		return scoreLanes<Sum,32/sizeof(Sum)>(bank,bases,threshold,prune,forward,rc);
+	}
+
+	template<class Sum>
+	__attribute__((target("avx512f"))) bool scoreAVX512(const BankView<Sum> & bank, const unsigned char * bases, Sum threshold, bool prune, Sum * forward, Sum * rc)
+	{
+		return scoreLanes<Sum,64/sizeof(Sum)>(bank,bases,threshold,prune,forward,rc);
+	}
+	#endif
+
+	template<class Sum>
+	struct KernelChoice
+	{
+		BankKernel<Sum> Function;
+		const char * Name;
+	};
+
+	template<class Sum>
+	KernelChoice<Sum> selectKernel()
+	{
+		#if defined(__x86_64__)
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f"))
+			{
+				return {scoreAVX512<Sum>,"avx512"};
+			}
+			if (__builtin_cpu_supports("avx2"))
+			{
+				return {scoreAVX2<Sum>,"avx2"};
+			}
+			return {scoreSSE2<Sum>,"sse2"};
+		#else
+			return {scoreScalar<Sum>,"scalar"};
+		#endif
+	}
+
+	template<class Sum>
+	const KernelChoice<Sum> & kernel()
+	{
+		static const KernelChoice<Sum> choice = selectKernel<Sum>();
+		return choice;
+	}
+}
+
+template<class Sum>
+MotifBank<Sum>::MotifBank(int length) : Length(length), Size(0), Bound(-std::numeric_limits<double>::infinity())
+{
+	const Sum empty = emptyWeight<Sum>(length);
+	Forward.assign(4*length*BankLanes,empty);
+	Reverse.assign(4*length*BankLanes,empty);
+	ForwardRemaining.assign((length+1)*BankLanes,empty*length);
+	ReverseRemaining.assign((length+1)*BankLanes,empty*length);
+}
+
+template<class Sum>
+void MotifBank<Sum>::Add(const std::vector<Sum> & weights, int flier, double bound)
+{
+	const int L = Length;
+	const int lane = Size;
+	for (int p = 0; p < L; ++p)
+	{
+		for (int b = 0; b < 4; ++b)
+		{
+			Forward[(4*p + b)*BankLanes + lane] = weights[4*p + b];
+			Reverse[(4*p + b)*BankLanes + lane] = weights[4*(L-1-p) + (b ^ Sequence::BitHackExtractor)];
+		}
+	}
+
+	//the forward strand has columns p onwards remaining after p steps, the reverse complement has columns 0 to L-p-1
+	std::vector<Sum> upper(L+1,0);
+	for (int p = 0; p < L; ++p)
+	{
+		upper[p+1] = upper[p] + *std::max_element(&weights[4*p],&weights[4*p] + 4);
+	}
+	for (int p = 0; p <= L; ++p)
+	{
+		ForwardRemaining[p*BankLanes + lane] = upper[L] - upper[p];
+		ReverseRemaining[p*BankLanes + lane] = upper[L-p];
+	}
+
+	Fliers.push_back(flier);
+	Bound = std::max(Bound,bound);
+	++Size;
+}
+
+template<class Sum>
+bool MotifBank<Sum>::Score(const unsigned char * bases, Sum threshold, bool prune, Sum * forward, Sum * rc, int stride) const
+{
+	BankView<Sum> view{Forward.data(),Reverse.data(),ForwardRemaining.data(),ReverseRemaining.data(),Length,Size,stride};
+	return kernel<Sum>().Function(view,bases,threshold,prune,forward,rc);
+}
+
+template<class Sum>
+const char * MotifBank<Sum>::Kernel()
+{
+	return kernel<Sum>().Name;
+}
+
+template class MotifBank<double>;
+template class MotifBank<fixedscore>;
@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include "../biology/MotifMatrix.h"
+
+const int BankLanes = 16; //the number of motifs scored together by a bank; a multiple of every kernel's vector width
+
+/*!
+	@brief Up to BankLanes on-the-fly motifs of equal length, interleaved so that they can all be scored at once with SIMD adds
+	@details The log-odds are held as [position][base][lane], so that at each position of the read the same base selects a contiguous vector of weights, one per motif. Each lane sums its columns in the same order as MotifMatrix::Score (summing the quantised log-odds in quantised mode), so that the sums are bit-identical to scoring the motifs one at a time. Sum is double, or fixedscore in quantised mode.
+
+	The kernel (AVX-512, AVX2 or SSE2, chosen at runtime, with a scalar fallback on other architectures) is shared by all banks.
+*/
+template<class Sum>
+class MotifBank
+{
+	public:
+		MotifBank(int length);
+
+		int Length;
+		int Size; //!< The number of lanes in use
+		double Bound; //!< The greatest score (in the units of Record::Score) which any motif in the bank can attain
+		std::vector<int> Fliers; //!< The index (into SequenceScanner::Fliers) of the motif held in each lane
+
+		//! Places a motif in the next free lane. weights are its log-odds, indexed [4*position + base] (and already divided by L in quantised mode)
+		void Add(const std::vector<Sum> & weights, int flier, double bound);
+		bool Full() const {return Size == BankLanes;};
+
+		/*!
+			@brief Sums the forward and reverse-complement scores of every lane at bases[0], bases[stride] ... bases[(Length-1)*stride] into forward and rc (each of BankLanes elements)
+			@details If prune is true, each vector of lanes is abandoned as soon as none of its lanes can reach threshold on either strand, and its sums are set to the lowest Sum.
+			@returns True if any lane reached threshold on either strand. If false, no lane needs to be checked
+		*/
+		bool Score(const unsigned char * bases, Sum threshold, bool prune, Sum * forward, Sum * rc, int stride = 1) const;
+
+		//! The name of the kernel chosen for this machine
+		static const char * Kernel();
+	private:
+		std::vector<Sum> Forward; //weights indexed [(4*position + base)*BankLanes + lane]
+		std::vector<Sum> Reverse; //as Forward, for the reverse complement: the weights of position L-1-p, complemented base
+		std::vector<Sum> ForwardRemaining; //[p*BankLanes + lane] the greatest sum of the forward columns p onwards
+		std::vector<Sum> ReverseRemaining;
+};
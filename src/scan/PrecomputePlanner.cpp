@@ -0,0 +1,235 @@
+#include "PrecomputePlanner.h"
+#include "ScanRecord.h"
+#include "SequenceScanner.h"
+#include "../parallel/numa.h"
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+PrecomputePlan::PrecomputePlan(const std::vector<MotifMatrix> & motifs, const InputEstimate & input) : Input(input)
+{
+	const size_t MiB = 1<<20;
+	const size_t limit = Settings.System.MemoryLimit * std::pow(1024,3);
+	const double threads = std::max((size_t)1,Settings.System.ParallelThreads.Value());
+	Reserved = (Settings.System.FlierMemo + threads * (2 * Settings.System.BatchSize + DecompressionRatio * Settings.System.DecompressionChunkSize)) * MiB;
+	if (Reserved >= limit)
+	{
+		LOG(WARN) << "The memo caches and I/O buffers (" << Reserved/MiB << " MiB) leave nothing of the memory budget (" << limit/MiB << " MiB, see -mem) for precomputed tables";
+	}
+	Budget = (Reserved < limit) ? limit - Reserved : 0;
+
+	//replicas are only made if the threads are pinned (see SequenceScanner::PlaceTables)
+	const size_t nodes = numaNodes().size();
+	Replicas = (Settings.System.NumaTables == 2 && Settings.System.PinThreads && nodes > 1) ? nodes : 1;
+
+	const bool quantised = Settings.System.ScoreResolution > 0;
+	const bool canonical = Settings.System.CanonicalTables;
+	const bool lazy = Settings.System.LazyTables;
+	const size_t entrySize = quantised ? sizeof(QuantisedElement) : sizeof(PrecomputeElement);
+	SplitWidth = Settings.System.SplitWidth;
+	if (SplitWidth > (int)Sequence::MaximumEncodingLength())
+	{
+		LOG(ERROR) << "The split width (" << SplitWidth << ") exceeds the maximum encoding length (" << Sequence::MaximumEncodingLength() << ")";
+		throw std::runtime_error("Invalid split width");
+	}
+
+	for (size_t i = 0; i < motifs.size(); ++i)
+	{
+		int L = motifs[i].size();
+		auto group = std::find_if(Groups.begin(),Groups.end(),[&](auto & g){return g.Length == L;});
+		if (group == Groups.end())
+		{
+			Groups.push_back({L,{},false,0,0,0,0,false});
+			group = Groups.end() - 1;
+		}
+		group->Motifs.push_back(i);
+	}
+	std::sort(Groups.begin(),Groups.end(),[](auto & a, auto & b){return a.Length < b.Length;});
+
+	//the split tables are only worth planning around if they fit with nothing precomputed
+	if (SplitWidth > 0)
+	{
+		size_t splitBytes = 0;
+		for (auto & group : Groups)
+		{
+			splitBytes += (group.Length > SplitWidth) ? group.Motifs.size() * SplitTable::Bytes(group.Length,SplitWidth) : 0;
+		}
+		if (splitBytes > Budget)
+		{
+			LOG(WARN) << "The split tables (" << splitBytes/MiB << " MiB) do not fit in the memory budget (" << Budget/MiB << " MiB), so the on-the-fly motifs are scored without them";
+			SplitWidth = 0;
+		}
+	}
+
+	for (auto & group : Groups)
+	{
+		const int L = group.Length;
+		const double n = group.Motifs.size();
+		//reads shorter than the motif contribute no windows
+		const double lookups = input.Reads * input.Windows(L);
+
+		//on the fly, the motifs are scored in banks of up to BankLanes, one column per base
+		group.OnTheFlyCost = lookups * std::ceil(n/BankLanes) * L * BankCostPerBase;
+		if (SplitWidth > 0 && L > SplitWidth)
+		{
+			//or if split, one lookup (of both strands) per sub-window of each motif
+			group.SplitBytes = n * SplitTable::Bytes(L,SplitWidth);
+			size_t tableBytes = (static_cast<size_t>(1) << (Sequence::LogAlphabetSize * SplitWidth)) * sizeof(SplitTable::Partial);
+			double splitLookupCost = (tableBytes > PrefetchTableSize) ? LookupCost : CachedLookupCost;
+			group.OnTheFlyCost = lookups * n * std::ceil(static_cast<double>(L)/SplitWidth) * splitLookupCost;
+		}
+
+		group.Eligible = (L <= (int)Sequence::MaximumEncodingLength()) && !Settings.System.DisablePrecompute;
+		if (!group.Eligible)
+		{
+			continue;
+		}
+		double entries = canonical ? Sequence::CanonicalIndexer(L).Size() : std::pow(4.0,L);
+		group.Bytes = entries * entrySize;
+		double lookupCost = (group.Bytes > PrefetchTableSize) ? LookupCost : CachedLookupCost;
+		if (lazy)
+		{
+			//a lazy table only computes the entries which are looked up, one at a time
+			double computed = std::min(entries,lookups);
+			group.TableCost = computed * n * L * BankCostPerBase + lookups * lookupCost;
+		}
+		else
+		{
+			group.TableCost = entries * (TableEntryCost + n * FillCostPerMotif) + lookups * lookupCost;
+		}
+	}
+
+	//the knapsack, over the budget in whole MiB (each table rounded up): best[c] is the greatest saving from the groups so far within c MiB, and taken[k][c] records whether group k was part of it. The split tables are set aside first, and a table's weight is what its replicas add to them
+	const size_t available = Budget - SplitBytes();
+	const size_t capacity = available / MiB;
+	auto weightOf = [&](const PlannedGroup & group) -> size_t {
+		size_t bytes = Replicas * group.Bytes;
+		size_t added = (bytes > group.SplitBytes) ? bytes - group.SplitBytes : 0;
+		return (added + MiB - 1)/MiB;
+	};
+	std::vector<size_t> candidates;
+	for (size_t k = 0; k < Groups.size(); ++k)
+	{
+		if (Groups[k].Eligible && Groups[k].Saving() > 0 && weightOf(Groups[k]) <= capacity)
+		{
+			candidates.push_back(k);
+		}
+	}
+	std::vector<double> best(capacity + 1,0);
+	std::vector<std::vector<bool>> taken(candidates.size(),std::vector<bool>(capacity + 1,false));
+	for (size_t c = 0; c < candidates.size(); ++c)
+	{
+		auto & group = Groups[candidates[c]];
+		size_t weight = weightOf(group);
+		for (size_t space = capacity; space + 1 > weight; --space)
+		{
+			double with = best[space - weight] + group.Saving();
+			if (with > best[space])
+			{
+				best[space] = with;
+				taken[c][space] = true;
+			}
+		}
+	}
+	size_t space = capacity;
+	for (size_t c = candidates.size(); c-- > 0;)
+	{
+		if (taken[c][space])
+		{
+			auto & group = Groups[candidates[c]];
+			group.Precompute = true;
+			space -= weightOf(group);
+		}
+	}
+}
+
+bool PrecomputePlan::Precomputes(int length) const
+{
+	for (auto & group : Groups)
+	{
+		if (group.Length == length)
+		{
+			return group.Precompute;
+		}
+	}
+	return false;
+}
+
+size_t PrecomputePlan::Bytes() const
+{
+	size_t bytes = 0;
+	for (auto & group : Groups)
+	{
+		bytes += group.Precompute ? Replicas * group.Bytes : 0;
+	}
+	return bytes;
+}
+
+size_t PrecomputePlan::SplitBytes() const
+{
+	size_t bytes = 0;
+	for (auto & group : Groups)
+	{
+		bytes += group.Precompute ? 0 : group.SplitBytes;
+	}
+	return bytes;
+}
+
+double PrecomputePlan::PredictedCost() const
+{
+	double cost = 0;
+	for (auto & group : Groups)
+	{
+		cost += group.Precompute ? group.TableCost : group.OnTheFlyCost;
+	}
+	return cost;
+}
+
+void PrecomputePlan::Print(std::ostream & out) const
+{
+	const double MiB = 1<<20;
+	out << "Precomputation plan for " << static_cast<size_t>(Input.Reads + 0.5) << " reads of mean length " << std::fixed << std::setprecision(1) << Input.MeanLength() << ", within " << Budget/MiB << " MiB (" << Reserved/MiB << " MiB of -mem is set aside for the memo caches and I/O buffers)\n";
+	out << std::setw(8) << "Length" << std::setw(8) << "Motifs" << std::setw(14) << "Table (MiB)" << std::setw(16) << "On-the-fly (s)" << std::setw(13) << "Table (s)" << "   Choice\n";
+	out << std::fixed;
+	for (auto & group : Groups)
+	{
+		out << std::setw(8) << group.Length << std::setw(8) << group.Motifs.size();
+		if (group.Eligible)
+		{
+			out << std::setw(14) << std::setprecision(1) << group.Bytes/MiB << std::setw(16) << std::setprecision(3) << group.OnTheFlyCost << std::setw(13) << group.TableCost;
+		}
+		else
+		{
+			out << std::setw(14) << "-" << std::setw(16) << std::setprecision(3) << group.OnTheFlyCost << std::setw(13) << "-";
+		}
+		std::string reason;
+		if (group.Precompute)
+		{
+			reason = "precompute";
+		}
+		else if (!group.Eligible)
+		{
+			reason = Settings.System.DisablePrecompute ? "on the fly (precomputation disabled)" : "on the fly (too long to encode)";
+		}
+		else if (group.Saving() <= 0)
+		{
+			reason = "on the fly (no faster precomputed)";
+		}
+		else
+		{
+			reason = "on the fly (does not fit in the budget)";
+		}
+		out << "   " << reason << "\n";
+	}
+	out << std::setprecision(1) << "Tables: " << Bytes()/MiB << " MiB";
+	if (Replicas > 1)
+	{
+		out << " (" << Replicas << " replicas of each)";
+	}
+	if (SplitWidth > 0)
+	{
+		out << "; split tables: " << SplitBytes()/MiB << " MiB";
+	}
+	out << "; predicted scan time: " << std::setprecision(3) << PredictedCost() << " s\n";
+	out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <ostream>
+#include "../biology/MotifMatrix.h"
+#include "InputSampler.h"
+
+//rough per-operation costs (in seconds) of the scan, measured on a desktop machine. Only their ratios matter to the plan; the absolute values only set the predicted time
+const double BankCostPerBase = 6e-9; //adding one column of a MotifBank, for one position of one read
+const double TableEntryCost = 8e-9; //initialising one entry of a precomputed table (the page faults, and the write)
+const double FillCostPerMotif = 5e-9; //checking one motif against one table entry, in FillTable's blocks
+const double CachedLookupCost = 10e-9; //one lookup into a table which fits in cache (see PrefetchTableSize)
+const double LookupCost = 30e-9; //one (prefetched) lookup into a larger table
+const double DecompressionRatio = 5; //a generous bound on the ratio of FASTQ text to its gzip compression, which sizes each decompressed chunk (see -gz-chunk)
+
+/*!
+	@brief The motifs of a single length, which are either precomputed into one table or scanned on the fly
+*/
+struct PlannedGroup
+{
+	int Length;
+	std::vector<int> Motifs; //!< Indices into the motif list
+	bool Eligible; //!< False if the group cannot be precomputed at all (too long to encode, or -disable-precompute)
+	size_t Bytes; //!< The size of the table
+	size_t SplitBytes; //!< The size of the split tables (see -split) which the motifs need if they are scanned on the fly
+	double OnTheFlyCost; //!< The predicted time (s) to scan the motifs on the fly
+	double TableCost; //!< The predicted time (s) to build the table, and make every lookup into it
+	bool Precompute;
+
+	double Saving() const {return OnTheFlyCost - TableCost;};
+};
+
+/*!
+	@brief The choice of which motif lengths to precompute, made for all of them at once
+	@details Every table costs memory (its real size, see Bytes), and saves the time by which scanning its motifs on the fly would exceed building it and looking every k-mer up. The plan is the set of tables with the greatest total saving whose sizes sum to no more than -mem: a 0/1 knapsack, solved exactly by dynamic programming over the budget in MiB.
+
+	The budget is what -mem leaves once the other memory of the scan is set aside (see Reserved). With -numa-tables 2, every table is stored once per node, so its weight is multiplied by Replicas.
+
+	With -split, the split tables of every on-the-fly motif are set aside from the budget first, and precomputing a group gives back those of its motifs. If the split tables alone do not fit, splitting is abandoned (with a warning) and SplitWidth is zero.
+*/
+class PrecomputePlan
+{
+	public:
+		/*!
+			@param motifs Every motif, in order
+			@param input The (estimated) number of reads which will be scanned, and their lengths
+		*/
+		PrecomputePlan(const std::vector<MotifMatrix> & motifs, const InputEstimate & input);
+
+		std::vector<PlannedGroup> Groups; //!< In order of motif length
+		size_t Budget; //!< The bytes of -mem available to the tables
+		size_t Reserved; //!< The bytes of -mem set aside for the memo caches (see -memo) and each thread's I/O buffers: a block of text and its output (see -batch), and a decompressed chunk (see -gz-chunk)
+		int Replicas; //!< The number of copies of each table (see -numa-tables)
+		int SplitWidth; //!< The -split width, or zero if the split tables are not built
+
+		//! True if motifs of this length are to be precomputed
+		bool Precomputes(int length) const;
+
+		size_t Bytes() const; //!< The total size of the chosen tables, counting every replica
+		size_t SplitBytes() const; //!< The total size of the split tables of the on-the-fly motifs
+		double PredictedCost() const; //!< The predicted time (s) to scan every motif, with the chosen tables
+		void Print(std::ostream & out) const;
+	private:
+		InputEstimate Input;
+};
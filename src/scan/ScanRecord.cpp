@@ -2,20 +2,35 @@
 
 
 
-void Record::CheckRecords(int motifID, double score, int pos, Direction dir, bool forceWin)
+void Record::Reset()
 {
-	if (score > Score || forceWin)
+	Score = -std::numeric_limits<double>::infinity();
+	Hits = 0;
+	Strand = Uninitialised;
+}
+
+void Record::CheckRecords(int motifID, double score, int pos, Direction dir, uint64_t order)
+{
+	score = static_cast<float>(score);
+	if (score > Score || Hits == 0)
 	{
 		MotifID = motifID;
 		Score = score;
 		Position = pos;
 		Strand = dir;
 		Hits = 1;
+		Order = order;
 	}
-	else if (abs(score - Score) < 1e-8)
+	else if (std::abs(score - Score) < TieTolerance)
 	{
 		++Hits;
+		if (order < Order)
+		{
+			MotifID = motifID;
+			Score = score;
+			Position = pos;
+			Strand = dir;
+			Order = order;
+		}
 	}
-
 }
-
@@ -1,7 +1,11 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <limits>
+#include <cmath>
 #include "../tools/Log.h"
+#include "../biology/DNASequence.h"
 enum Direction
 {
 	Forward,
@@ -25,41 +29,169 @@ std::string inline directionString(Direction dir)
 	}
 }
 
+const double TieTolerance = 1e-8; //scores which differ by less than this are counted as ties
+
+/*!
+	@brief The best (score, strand, motif) of a single k-mer, packed into 8 bytes.
+	@details The score is held as a float (the output is only given to 6 decimal places), and the strand is packed alongside a 30-bit motif ID. An empty element is marked by a NaN score. Every score is rounded to float before it is compared, here and in Record::CheckRecords, so that a precomputed table and an on-the-fly scan see the same ties.
+
+	Only the first of several tied checks is kept, so Tied marks the entries whose k-mer must be re-checked motif by motif (see SequenceScanner::CheckTied) to count the ties and settle their winner.
+*/
 struct PrecomputeElement
 {
-	double Score;
-	Direction Strand;
-	int MotifID;
+	float Score;
+	uint32_t Strand : 1;
+	uint32_t Tied : 1;
+	uint32_t MotifID : 30;
 
-	PrecomputeElement(){Strand = Uninitialised;};
+	PrecomputeElement(){Score = std::numeric_limits<float>::quiet_NaN(); Strand = Forward; Tied = false; MotifID = 0;};
 
 	void CheckElement(double fscore, double rcscore,int motif)
 	{
-		if (fscore > Score || Strand == Uninitialised)
-		{
-			Score = fscore;
-			Strand = Forward;
-			MotifID = motif;
-		}
-		if (rcscore > Score)
+		Check(fscore,Forward,motif);
+		Check(rcscore,Backward,motif);
+	};
+	private:
+		//the rule of Record::CheckRecords
+		void Check(float score, Direction dir, int motif)
 		{
-			Score = rcscore;
-			Strand = Backward;
-			MotifID = motif;
-		}
+			if (score > Score || std::isnan(Score))
+			{
+				Score = score;
+				Strand = dir;
+				Tied = false;
+				MotifID = motif;
+			}
+			else if (std::abs(score - Score) < TieTolerance)
+			{
+				Tied = true;
+			}
+		};
+};
+
+/*!
+	@brief The fixed-point analogue of PrecomputeElement, used when scores are quantised. Half the size.
+	@details Scores are stored as int16 (MotifMatrix::Quantise clamps the log-odds so that no sum can overflow), and the strand and the Tied mark are packed alongside a 14-bit motif ID. An empty element is marked by the lowest int16 score, which no quantised score can reach. Quantised scores are whole numbers, so ties are exact.
+*/
+struct QuantisedElement
+{
+	static constexpr int16_t Empty = std::numeric_limits<int16_t>::min();
+	static constexpr int MaxMotifs = 1<<14;
+
+	int16_t Score;
+	uint16_t Strand : 1;
+	uint16_t Tied : 1;
+	uint16_t MotifID : 14;
+
+	QuantisedElement(){Score = Empty; Strand = Forward; Tied = false; MotifID = 0;};
+
+	void CheckElement(fixedscore fscore, fixedscore rcscore, int motif)
+	{
+		Check(fscore,Forward,motif);
+		Check(rcscore,Backward,motif);
 	};
+	private:
+		void Check(fixedscore score, Direction dir, int motif)
+		{
+			if (score > Score)
+			{
+				Score = score;
+				Strand = dir;
+				Tied = false;
+				MotifID = motif;
+			}
+			else if (score == Score)
+			{
+				Tied = true;
+			}
+		};
 };
 
 class Record
 {
 	public:
-		double Score;
+		double Score; //!< When scores are quantised, this is a whole number of resolution steps
 		int Position;
 		Direction Strand;
 		int Hits;
 		int MotifID;
-		void CheckRecords(int motifID, double score, int pos, Direction dir, bool forceWin);
+		uint64_t Order; //!< The order of the check which set the current best (see CheckRecords)
+
+		//!Empties the record, ready for a new sequence
+		void Reset();
+
+		/*!
+			@brief Replaces the current best if score beats it, or counts a hit if it ties
+			@details The score is first rounded to float, the precision of the precomputed tables, so that every path sees the same ties. Checks may be made in any order: ties are won by the check with the lowest order, so that the result is identical to making the checks in ascending order.
+		*/
+		void CheckRecords(int motifID, double score, int pos, Direction dir, uint64_t order);
 		std::string ToString();
 };
 
+typedef double LaneScores __attribute__((vector_size(Sequence::BatchLanes*sizeof(double))));
+typedef int64_t LaneInts __attribute__((vector_size(Sequence::BatchLanes*sizeof(int64_t))));
+typedef float LaneFloats __attribute__((vector_size(Sequence::BatchLanes*sizeof(float))));
+
+/*!
+	@brief One Record per read of a Sequence::ReadBatch, held as vectors so that a check is made against every read at once
+	@details CheckLanes applies the logic of Record::CheckRecords to every active lane with compares and blends, rather than branches. Masks (such as active) are -1 in lanes which are true, and 0 otherwise.
+*/
+class BatchRecord
+{
+	public:
+		LaneScores Score;
+		LaneInts Position;
+		LaneInts Strand;
+		LaneInts Hits;
+		LaneInts MotifID;
+		LaneInts Order;
+
+		//! Empties every lane
+		void Reset()
+		{
+			Score = LaneScores{} - std::numeric_limits<double>::infinity();
+			Hits = LaneInts{};
+			Strand = LaneInts{} + (int64_t)Uninitialised;
+		};
+
+		//! Record::CheckRecords, made in every lane where active is set
+		void CheckLanes(LaneInts active, LaneScores score, LaneInts motifID, LaneInts pos, LaneInts dir, LaneInts order)
+		{
+			score = __builtin_convertvector(__builtin_convertvector(score,LaneFloats),LaneScores);
+			LaneInts beat = active & ((score > Score) | (Hits == 0));
+			LaneInts tie = active & ~beat & ((score - Score < TieTolerance) & (Score - score < TieTolerance));
+			LaneInts replace = beat | (tie & (Order > order));
+			Hits = beat ? LaneInts{} + 1 : Hits - tie;
+			Score = replace ? score : Score;
+			MotifID = replace ? motifID : MotifID;
+			Position = replace ? pos : Position;
+			Strand = replace ? dir : Strand;
+			Order = replace ? order : Order;
+		};
+
+		//! Record::CheckRecords, made in a single lane
+		void CheckLane(int lane, int motifID, double score, int pos, Direction dir, uint64_t order)
+		{
+			Record record = Lane(lane);
+			record.CheckRecords(motifID,score,pos,dir,order);
+			Score[lane] = record.Score;
+			Position[lane] = record.Position;
+			Strand[lane] = record.Strand;
+			Hits[lane] = record.Hits;
+			MotifID[lane] = record.MotifID;
+			Order[lane] = record.Order;
+		};
 
+		//! The result held in a single lane
+		Record Lane(int lane) const
+		{
+			Record out;
+			out.Score = Score[lane];
+			out.Position = Position[lane];
+			out.Strand = (Direction)Strand[lane];
+			out.Hits = Hits[lane];
+			out.MotifID = MotifID[lane];
+			out.Order = Order[lane];
+			return out;
+		};
+};
@@ -1,7 +1,13 @@
 #include "SequenceScanner.h"
+#include "PrecomputePlanner.h"
+#include <sstream>
 #include <iomanip>
 #include <cmath>
-#include "../tools/formatter.h"
+#include <numeric>
+#include <algorithm>
+#include <charconv>
+#include <bit>
+#include <thread>
 
 // #include <format>
 
@@ -9,10 +15,29 @@
 
 
 
-SequenceScanner::SequenceScanner(std::vector<fs_path> motifPaths, int sequenceCount, int sequenceLength)
+SequenceScanner::SequenceScanner(std::vector<fs_path> motifPaths, ParallelPool & pool, const InputEstimate & input)
 {
 	std::vector<std::string> registry;
 	Motifs.resize(0);
+	Quantised = Settings.System.ScoreResolution > 0;
+	ScoreUnit = Quantised ? Settings.System.ScoreResolution.Value() : 1.0;
+	Canonical = Settings.System.CanonicalTables;
+	Prune = Settings.System.PruneFliers;
+	SortedLookupMode = Settings.System.SortedLookups;
+	HugePages = Settings.System.HugePages;
+	Replicate = false;
+	Lazy = Settings.System.LazyTables;
+	if (Settings.System.FlierMemo < 0)
+	{
+		LOG(ERROR) << "The memo cache size must be positive (or zero, to disable the cache)";
+		throw std::runtime_error("Invalid memo size");
+	}
+	MemoBytes = Settings.System.FlierMemo * (1<<20) / std::max((size_t)1,Settings.System.ParallelThreads.Value());
+	if (Settings.System.ScoreResolution < 0)
+	{
+		LOG(ERROR) << "The score resolution must be positive (or zero, to disable quantisation)";
+		throw std::runtime_error("Invalid score resolution");
+	}
 	int count = 0;
 	for (auto path : motifPaths)
 	{
@@ -30,63 +55,50 @@ SequenceScanner::SequenceScanner(std::vector<fs_path> motifPaths, int sequenceCo
 		}
 
 	}
-	InitialiseMotifs(sequenceCount,sequenceLength);
-}
-
-bool PrecomputationAllowed(size_t sequenceCount, size_t meanSize, size_t motifLength, int callingID)
-{
-
-	//Check if precomputing would actually speed things up
-	long long int PrecomputeSize = pow(4,motifLength); // number of k-mers required for precomputing
-	long long int ExpectedKmerCount = sequenceCount *  std::max(1,(int)(meanSize - motifLength)); 
-	bool isFaster = (ExpectedKmerCount * 1.0/PrecomputeSize > 1);
-
-	//Check if precomputing possible within encoding limitations
-	bool smallEnoughForEncoding = (Sequence::MaximumEncodingLength() >= motifLength);
-
-	//Check if memory footprint would be ludicrous
-	//footprint factor estimates global memory from this single factor, chosen by user (default = 100)
-	double expectedGlobalFootprint = (PrecomputeSize * sizeof(double)) *1.0/ pow(1024,3) * Settings.System.FootprintFactor;
-	bool fitsInMemory = (expectedGlobalFootprint <= Settings.System.MemoryLimit);
-	
-	bool verdict = (isFaster) && (smallEnoughForEncoding) && (fitsInMemory) && !(Settings.System.DisablePrecompute.Value());
-
-	if (Settings.System.Verbosity >= LogLevel::DEBUG)
-	{
-		//output a nicely formatted table reasoning why precomputation was initialised (or not)
-		std::stringstream buffer;
-		buffer << "Analysing Motif " << callingID;
-		buffer << "\n   Length:   " << std::setw(6) << motifLength;
-		buffer << "\tPC-Kmers: " << std::setw(12)<< PrecomputeSize;
-		buffer << "\tEst-Kmers: " << std::setw(10) << ExpectedKmerCount;
-		buffer << "\tFootprint: " << std::setw(10) << expectedGlobalFootprint << "GiB";
-		buffer << "\n   Speedgain:" << std::setw(6) << MakeString(isFaster);
-		buffer << "\tEncoder valid:" << std::setw(8) << MakeString(smallEnoughForEncoding);
-		buffer << "\tIn memory: " << std::setw(10) << MakeString(fitsInMemory);
-		buffer << "\tUser Disabled:" << std::setw(10) << MakeString(Settings.System.DisablePrecompute.Value()); 
-		buffer << "\n   Verdict:   ";
-		if (verdict)
-		{
-			buffer << "PRECOMPUTE";
+	if (Quantised)
+	{
+		if (Motifs.size() > QuantisedElement::MaxMotifs)
+		{
+			LOG(ERROR) << "Quantised score tables can hold at most " << QuantisedElement::MaxMotifs << " motifs, but " << Motifs.size() << " were loaded";
+			throw std::runtime_error("Too many motifs for quantisation");
 		}
-		else
+		LOG(INFO) << "Quantising motif scores to a resolution of " << ScoreUnit;
+		for (auto & motif : Motifs)
 		{
-			buffer << "ON-THE-FLY";
+			motif.Quantise(ScoreUnit);
 		}
-		LOG(DEBUG) << buffer.str();
 	}
-	return verdict;
+	InitialiseMotifs(input,pool);
+}
+
+//the mask selecting the final L bases of a code (written to avoid an overlong shift when L fills the whole of dnabits)
+dnabits windowMask(int L)
+{
+	int bits = Sequence::LogAlphabetSize * L;
+	return (bits >= (int)(8*sizeof(dnabits))) ? ~static_cast<dnabits>(0) : (static_cast<dnabits>(1) << bits) - 1;
 }
 
-void SequenceScanner::InitialiseMotifs(int sequenceCount, int sequenceLength)
+void SequenceScanner::InitialiseMotifs(const InputEstimate & input, ParallelPool & pool)
 {
-	for (int i = 0; i < Motifs.size(); ++i)
+	//which motifs are precomputed is decided for all lengths at once, within the memory budget (see PrecomputePlan)
+	PrecomputePlan plan(Motifs,input);
+	SplitWidth = plan.SplitWidth;
+	std::ostringstream planText;
+	plan.Print(planText);
+	if (Settings.System.PlanOnly)
+	{
+		std::cout << planText.str() << std::flush;
+	}
+	else
 	{
+		LOG(DEBUG) << planText.str();
+	}
 
-		auto & newMotif = Motifs[i];
+	for (int i = 0; i < (int)Motifs.size(); ++i)
+	{
 
 		//now determine if the motif will be precomputed or on-the-fly
-		if (PrecomputationAllowed(sequenceCount,sequenceLength,newMotif.size(),newMotif.ID))
+		if (plan.Precomputes(Motifs[i].size()))
 		{
 			//if precomputed, group it with all the other precomputation grids with the same motif length
 
@@ -131,8 +143,98 @@ void SequenceScanner::InitialiseMotifs(int sequenceCount, int sequenceLength)
 		{
 			LOG(DEBUG) << "    " << Precomputers[j].size() << " motifs of size " << PrecomputedSizes[j]; 
 		}
-		Precompute();
 	}
+	//a dry run only reports the plan
+	if (Settings.System.PlanOnly)
+	{
+		return;
+	}
+	if (PrecomputedSizes.size() > 0)
+	{
+		Precompute(pool);
+	}
+	BuildSplitTables(pool);
+	PrepareSweep();
+}
+
+size_t SplitTable::Bytes(int L, int width)
+{
+	size_t bytes = 0;
+	for (int start = 0; start < L; start += width)
+	{
+		bytes += (static_cast<size_t>(1) << (Sequence::LogAlphabetSize * std::min(width,L - start))) * sizeof(Partial);
+	}
+	return bytes;
+}
+
+void SequenceScanner::BuildSplitTables(ParallelPool & pool)
+{
+	Splits.resize(Fliers.size());
+	if (SplitWidth == 0)
+	{
+		return;
+	}
+	std::vector<std::pair<int,int>> subwindows; //(flier, sub-window) pairs, which are filled in parallel
+	for (size_t i = 0; i < Fliers.size(); ++i)
+	{
+		int L = Motifs[Fliers[i]].size();
+		if (L <= SplitWidth)
+		{
+			continue;
+		}
+		auto & split = Splits[i];
+		for (int start = 0; start < L; start += SplitWidth)
+		{
+			int width = std::min(SplitWidth,L - start);
+			split.Widths.push_back(width);
+			split.Masks.push_back(windowMask(width));
+			split.Partials.emplace_back(static_cast<size_t>(1) << (Sequence::LogAlphabetSize * width));
+			subwindows.push_back({i,(int)split.Widths.size() - 1});
+		}
+	}
+	if (subwindows.size() == 0)
+	{
+		return;
+	}
+	LOG(INFO) << "Building split tables for " << std::count_if(Splits.begin(),Splits.end(),[](auto & split){return split.Widths.size() > 0;}) << " on-the-fly arrays";
+
+	pool.For(subwindows.size(),[&](int k)
+	{
+		auto [i,c] = subwindows[k];
+		auto & motif = Motifs[Fliers[i]];
+		auto & scores = motif.ReferenceScores();
+		auto & quantisedScores = motif.ReferenceQuantisedScores();
+		int L = motif.size();
+		auto & split = Splits[i];
+		int offset = c * SplitWidth;
+		int width = split.Widths[c];
+		auto & partials = split.Partials[c];
+		for (dnabits code = 0; code < partials.size(); ++code)
+		{
+			double fscore = 0;
+			double rcscore = 0;
+			dnabits decoder = code;
+			for (int q = width - 1; q >= 0; --q)
+			{
+				//position p of the motif holds base q of the sub-window
+				int p = offset + q;
+				int base = decoder & Sequence::BitHackExtractor;
+				int rcbase = base ^ Sequence::BitHackExtractor;
+				decoder = decoder >> Sequence::LogAlphabetSize;
+				if (Quantised)
+				{
+					fscore += quantisedScores[4*p + base];
+					rcscore += quantisedScores[4*(L-1-p) + rcbase];
+				}
+				else
+				{
+					fscore += scores[p][base];
+					rcscore += scores[L-1-p][rcbase];
+				}
+			}
+			partials[code] = {static_cast<float>(fscore),static_cast<float>(rcscore)};
+		}
+	});
 }
 
 size_t SequenceScanner::size() const
@@ -140,96 +242,1273 @@ size_t SequenceScanner::size() const
 	return NMotifs;
 }
 
-void SequenceScanner::Precompute()
+//the number of trailing bases over which FillTable extends its partial sums; for canonical tables these must lie within the right-hand flank (see Sequence::CanonicalIndexer)
+int tailBases(int L, const Sequence::CanonicalIndexer * indexer)
 {
-	int nPrecompute = NMotifs - Fliers.size();
-	int completed = 0;
-	PrecomputedScores.resize(Precomputers.size());
-	
-	ProgressBar PB(nPrecompute,"Precomputing Score Tables\n");
+	const int maxTail = 6; //4^6 partial sums per buffer
+	int available = indexer ? indexer->FlankWidth() : L;
+	return std::min(maxTail,available);
+}
+
+//the number of consecutive table entries sharing all but their trailing bases
+size_t blockSize(int L, const Sequence::CanonicalIndexer * indexer)
+{
+	size_t nSlots = indexer ? indexer->Slots() : 1;
+	return nSlots << (Sequence::LogAlphabetSize * tailBases(L,indexer));
+}
+
+void SequenceScanner::Precompute(ParallelPool & pool)
+{
+	if (Quantised)
+	{
+		QuantisedScores.resize(Precomputers.size());
+	}
+	else
+	{
+		PrecomputedScores.resize(Precomputers.size());
+	}
+
+	//the tables are divided into tiles small enough to stay in cache whilst every motif of the group is checked against them, and the tiles are shared between the threads
+	struct Tile
+	{
+		int Group;
+		size_t Start;
+		size_t End;
+	};
+	std::vector<Tile> tiles;
+	const size_t elementSize = Quantised ? sizeof(QuantisedElement) : sizeof(PrecomputeElement);
+	TableCache cache(Lazy ? "" : Settings.System.TableCache.Value()); //lazy tables are never complete, so are not cached
+	GroupColumns.resize(Quantised ? 0 : PrecomputedSizes.size());
+	QuantisedGroupColumns.resize(Quantised ? PrecomputedSizes.size() : 0);
+	std::vector<uint64_t> keys(PrecomputedSizes.size());
+	std::vector<bool> built(PrecomputedSizes.size(),true);
 	for (int i = 0; i < PrecomputedSizes.size(); ++i)
 	{
 		//all motifs in this section have the same motif length
 		int L = Motifs[Precomputers[i][0]].size();
 	
 		//there are 4^L L-mers, and we're going to iterate over all of them
-		//This is why it's important to check that this is feasible! (See: PrecomputationAllowed())
-		dnabits nCodes = std::pow(4,L);	
-		PrecomputedScores[i].resize(nCodes);
+		//This is why it's important to check that this is feasible! (See: PrecomputePlan)
+		size_t nCodes = std::pow(4,L);	
+		Indexers.emplace_back(L);
+		if (Canonical)
+		{
+			nCodes = Indexers[i].Size();
+		}
+
+		//the columns are needed by lazy tables, and to re-check tied entries
+		if (Quantised)
+		{
+			QuantisedGroupColumns[i].resize(8*L*Precomputers[i].size());
+			for (size_t j = 0; j < Precomputers[i].size(); ++j)
+			{
+				MotifColumns(Precomputers[i][j],L,&QuantisedGroupColumns[i][8*L*j],&QuantisedGroupColumns[i][(8*j+4)*L]);
+			}
+		}
+		else
+		{
+			GroupColumns[i].resize(8*L*Precomputers[i].size());
+			for (size_t j = 0; j < Precomputers[i].size(); ++j)
+			{
+				MotifColumns(Precomputers[i][j],L,&GroupColumns[i][8*L*j],&GroupColumns[i][(8*j+4)*L]);
+			}
+		}
+
+		//lazy tables are left empty (the zero bytes of fresh pages): entries are computed as they are first looked up (see Entry)
+		if (Lazy)
+		{
+			if (Quantised)
+			{
+				QuantisedScores[i].Allocate(nCodes,HugePages);
+			}
+			else
+			{
+				PrecomputedScores[i].Allocate(nCodes,HugePages);
+			}
+			built[i] = false;
+			continue;
+		}
+
+		//a table already in the cache is mapped as it is, rather than rebuilt
+		if (cache.Enabled())
+		{
+			keys[i] = TableKey(i,nCodes);
+			HugePageBuffer mapped;
+			if (cache.Load(keys[i],nCodes * elementSize,mapped))
+			{
+				if (Quantised)
+				{
+					QuantisedScores[i].Adopt(std::move(mapped),nCodes);
+				}
+				else
+				{
+					PrecomputedScores[i].Adopt(std::move(mapped),nCodes);
+				}
+				built[i] = false;
+				LOG(INFO) << "Loaded the table for size " << L << " from the cache (" << cache.Path(keys[i]) << ")";
+				continue;
+			}
+		}
 
+		//the tables are left uninitialised here: each tile is initialised just before it is filled, so every page is written once, whilst in cache
+		if (Quantised)
+		{
+			QuantisedScores[i].Allocate(nCodes,HugePages);
+		}
+		else
+		{
+			PrecomputedScores[i].Allocate(nCodes,HugePages);
+		}
+
+		//tiles must hold a whole number of FillTable's blocks
+		size_t block = blockSize(L,Canonical ? &Indexers[i] : nullptr);
+		size_t tileSize = block * std::max((size_t)1,PrecomputeTileSize/block);
+		for (size_t start = 0; start < nCodes; start += tileSize)
+		{
+			tiles.push_back({i,start,std::min(nCodes,start + tileSize)});
+		}
+	}
+
+	//the NUMA placement must be set before the tables are first written
+	if (Quantised)
+	{
+		PlaceTables(QuantisedScores,pool);
+	}
+	else
+	{
+		PlaceTables(PrecomputedScores,pool);
+	}
+
+	ProgressBar PB(tiles.size(),"Precomputing Score Tables\n");
+	std::atomic<int> completed = 0;
+	std::mutex progressLock;
+	pool.For(tiles.size(),[&](int t)
+	{
+		auto & tile = tiles[t];
+		int i = tile.Group;
+		int L = PrecomputedSizes[i];
+		const Sequence::CanonicalIndexer * indexer = Canonical ? &Indexers[i] : nullptr;
+		if (Quantised)
+		{
+			std::fill(&QuantisedScores[i][tile.Start],&QuantisedScores[i][tile.End],QuantisedElement());
+		}
+		else
+		{
+			std::fill(&PrecomputedScores[i][tile.Start],&PrecomputedScores[i][tile.End],PrecomputeElement());
+		}
+
+		//motifs are checked in the same order as a motif-by-motif fill, so ties resolve identically
 		for (int j = 0; j < Precomputers[i].size(); ++j)
 		{
-			PB.Update(completed);	
-			auto scores = Motifs[Precomputers[i][j]].ReferenceScores();//const reference to the internal log-odds of the relevant motif
-			
-			for (dnabits code = 0; code < nCodes; ++code)
+			if (Quantised)
 			{
-				double fscore = 0;
-				double rcscore = 0;
-				dnabits decoder = code;
-				for (int i = 0; i < L; ++i)
+				FillTable(QuantisedScores[i],Precomputers[i][j],L,indexer,tile.Start,tile.End);
+			}
+			else
+			{
+				FillTable(PrecomputedScores[i],Precomputers[i][j],L,indexer,tile.Start,tile.End);
+			}
+		}
+
+		int done = ++completed;
+		if (progressLock.try_lock())
+		{
+			PB.Update(done);
+			progressLock.unlock();
+		}
+	});
+
+	for (size_t i = 0; i < PrecomputedSizes.size(); ++i)
+	{
+		if (built[i] && cache.Enabled())
+		{
+			size_t entries = Quantised ? QuantisedScores[i].size() : PrecomputedScores[i].size();
+			const void * data = Quantised ? (const void*)QuantisedScores[i].data() : (const void*)PrecomputedScores[i].data();
+			cache.Store(keys[i],data,entries * elementSize);
+			LOG(INFO) << "Saved the table for size " << PrecomputedSizes[i] << " to the cache (" << cache.Path(keys[i]) << ")";
+		}
+	}
+
+	if (Replicate)
+	{
+		if (Quantised)
+		{
+			Replicas(QuantisedScores,QuantisedReplicas);
+		}
+		else
+		{
+			Replicas(PrecomputedScores,PrecomputedReplicas);
+		}
+	}
+
+	//transparent huge pages are only granted as the pages are touched, so the backing can only be reported once the tables are full
+	auto report = [&](auto & tables, size_t elementSize){
+		for (size_t i = 0; i < tables.size(); ++i)
+		{
+			double MiB = 1.0/(1<<20);
+			LOG(DEBUG) << "    The table for size " << PrecomputedSizes[i] << " (" << tables[i].size() * elementSize * MiB << " MiB) requested " << HugePageBuffer::Name(tables[i].Kind()) << "; " << tables[i].HugeBytes() * MiB << " MiB are backed by huge pages";
+		}
+	};
+	if (Quantised)
+	{
+		report(QuantisedScores,sizeof(QuantisedElement));
+	}
+	else
+	{
+		report(PrecomputedScores,sizeof(PrecomputeElement));
+	}
+}
+
+uint64_t SequenceScanner::TableKey(int group, size_t entries) const
+{
+	//everything on which the contents of the table depend: the entry format, the indexing, and the log-odds of each motif (in order, since the order settles ties and gives the stored IDs)
+	TableHash hash;
+	hash.Add(Quantised);
+	hash.Add(ScoreUnit);
+	hash.Add(Canonical);
+	hash.Add(PrecomputedSizes[group]);
+	hash.Add(entries);
+	hash.Add(Quantised ? sizeof(QuantisedElement) : sizeof(PrecomputeElement));
+	for (int id : Precomputers[group])
+	{
+		hash.Add(id);
+		if (Quantised)
+		{
+			auto & scores = Motifs[id].ReferenceQuantisedScores();
+			hash.Add(scores.data(),scores.size() * sizeof(fixedscore));
+		}
+		else
+		{
+			for (auto & column : Motifs[id].ReferenceScores())
+			{
+				hash.Add(column.data(),column.size() * sizeof(double));
+			}
+		}
+	}
+	return hash.Value();
+}
+
+template<class Element>
+void SequenceScanner::PlaceTables(std::vector<HugePageArray<Element>> & tables, ParallelPool & pool)
+{
+	Replicate = false;
+	const int nNodes = numaNodes().size();
+	size_t policy = Settings.System.NumaTables;
+	if (policy == 0 || nNodes == 1)
+	{
+		return;
+	}
+	if (policy > 2)
+	{
+		LOG(ERROR) << "-numa-tables must be 0 (single copy), 1 (interleaved) or 2 (replicated), not " << policy;
+		throw std::runtime_error("Invalid NUMA table policy");
+	}
+
+	size_t bytes = 0;
+	for (auto & table : tables)
+	{
+		bytes += table.size() * sizeof(Element);
+	}
+	if (policy == 2)
+	{
+		double replicatedFootprint = nNodes * bytes * 1.0/pow(1024,3);
+		if (!pool.IsPinned())
+		{
+			LOG(WARN) << "Replicated tables require pinned threads (-pin), so that each thread knows its node. The tables will be interleaved instead";
+		}
+		else if (replicatedFootprint > Settings.System.MemoryLimit)
+		{
+			LOG(WARN) << "Replicating the tables on " << nNodes << " nodes would need " << replicatedFootprint << "GiB, more than the limit of " << Settings.System.MemoryLimit << "GiB (-mem). The tables will be interleaved instead";
+		}
+		else
+		{
+			Replicate = true;
+		}
+	}
+
+	//the primary copy is the replica of the first node, however the threads which fill it are spread
+	for (auto & table : tables)
+	{
+		//tables mapped from the cache live in the (shared) page cache, where they are placed by the kernel
+		if (table.Kind() == PageKind::File)
+		{
+			continue;
+		}
+		size_t tableBytes = table.size() * sizeof(Element);
+		bool placed = Replicate ? bindMemory(table.data(),tableBytes,0,false) : interleaveMemory(table.data(),tableBytes);
+		if (!placed)
+		{
+			LOG(WARN) << "The kernel refused the NUMA placement of the score tables; they are left where they are first written";
+			Replicate = false;
+			return;
+		}
+	}
+	LOG(INFO) << "Score tables (" << bytes * 1.0/pow(1024,3) << "GiB) will be " << (Replicate ? "replicated on" : "interleaved across") << " " << nNodes << " NUMA nodes";
+}
+
+template<class Element>
+void SequenceScanner::Replicas(const std::vector<HugePageArray<Element>> & tables, std::vector<std::vector<HugePageArray<Element>>> & replicas)
+{
+	//each replica is allocated and copied by a thread pinned to its node, and bound there, so that every page is local to the threads which read it
+	const int nNodes = numaNodes().size();
+	replicas.resize(nNodes - 1);
+	std::vector<std::thread> copiers;
+	for (int node = 1; node < nNodes; ++node)
+	{
+		copiers.emplace_back([&,node](){
+			pinThread(node);
+			auto & replica = replicas[node-1];
+			replica.resize(tables.size());
+			for (size_t i = 0; i < tables.size(); ++i)
+			{
+				replica[i].Allocate(tables[i].size(),HugePages);
+				bindMemory(replica[i].data(),tables[i].size() * sizeof(Element),node,false);
+				//lazy replicas start as empty as the primary, and fill independently
+				if (!Lazy)
 				{
-					int base = decoder & Sequence::BitHackExtractor;
-					int rcbase = base ^ Sequence::BitHackExtractor;
-					decoder = decoder >> Sequence::LogAlphabetSize;
-					fscore += scores[L-i-1][base];
-					rcscore += scores[i][rcbase];
+					std::copy(tables[i].data(),tables[i].data() + tables[i].size(),replica[i].data());
 				}
+			}
+		});
+	}
+	for (auto & copier : copiers)
+	{
+		copier.join();
+	}
+}
+
+template<bool quantised>
+auto & SequenceScanner::LocalTables()
+{
+	auto & replicas = [&]() -> auto & {
+		if constexpr (quantised)
+		{
+			return QuantisedReplicas;
+		}
+		else
+		{
+			return PrecomputedReplicas;
+		}
+	}();
+	int node = numaNode();
+	if (node > 0 && node <= (int)replicas.size())
+	{
+		return replicas[node-1];
+	}
+	if constexpr (quantised)
+	{
+		return QuantisedScores;
+	}
+	else
+	{
+		return PrecomputedScores;
+	}
+}
 
-				//this is where the magic happens. We compute both the forward and rc score, and then check them against the scores achieved by *all of the motifs in the set*.
-				//We then store the winner. We then only need to do a single lookup for each subsequence to learn the best-scoring motif, and the best-scoring direction
-				PrecomputedScores[i][code].CheckElement(fscore/L,rcscore/L,Precomputers[i][j]);	
+template<class Sum>
+void SequenceScanner::MotifColumns(int motifID, int L, Sum * forwardColumn, Sum * rcColumn) const
+{
+	auto & motif = Motifs[motifID];
+	auto & scores = motif.ReferenceScores();//const reference to the internal log-odds of the relevant motif
+	auto & quantisedScores = motif.ReferenceQuantisedScores();
+	for (int p = 0; p < L; ++p)
+	{
+		for (int b = 0; b < 4; ++b)
+		{
+			int rcb = b ^ Sequence::BitHackExtractor;
+			if constexpr (std::is_same_v<Sum,fixedscore>)
+			{
+				forwardColumn[4*p+b] = quantisedScores[4*p + b];
+				rcColumn[4*p+b] = quantisedScores[4*(L-1-p) + rcb];
+			}
+			else
+			{
+				forwardColumn[4*p+b] = scores[p][b];
+				rcColumn[4*p+b] = scores[L-1-p][rcb];
 			}
-			++completed;
 		}
 	}
 }
 
+template<class Element>
+void SequenceScanner::ComputeEntry(int group, size_t index, Element & element) const
+{
+	constexpr bool quantised = std::is_same_v<Element,QuantisedElement>;
+	using Sum = std::conditional_t<quantised,fixedscore,double>;
+	auto & columns = [&]() -> auto & {
+		if constexpr (quantised)
+		{
+			return QuantisedGroupColumns[group];
+		}
+		else
+		{
+			return GroupColumns[group];
+		}
+	}();
+	const int L = PrecomputedSizes[group];
+	const Sequence::CanonicalIndexer * indexer = Canonical ? &Indexers[group] : nullptr;
+	dnabits code = indexer ? indexer->Code(index) : index;
+	unsigned char bases[8*sizeof(dnabits)/Sequence::LogAlphabetSize];
+	for (int p = L - 1; p >= 0; --p)
+	{
+		bases[p] = code & Sequence::BitHackExtractor;
+		code = code >> Sequence::LogAlphabetSize;
+	}
+
+	//the sums are made in the same order as FillTable's (the shared prefix backwards, then the tail forwards), so that the entry is bit-identical to an eagerly filled one
+	const int m = tailBases(L,indexer);
+	element = Element();
+	for (size_t j = 0; j < Precomputers[group].size(); ++j)
+	{
+		const Sum * forwardColumn = &columns[8*L*j];
+		const Sum * rcColumn = forwardColumn + 4*L;
+		Sum forward = 0;
+		Sum rc = 0;
+		for (int p = L - m - 1; p >= 0; --p)
+		{
+			forward += forwardColumn[4*p + bases[p]];
+			rc += rcColumn[4*p + bases[p]];
+		}
+		for (int p = L - m; p < L; ++p)
+		{
+			forward += forwardColumn[4*p + bases[p]];
+			rc += rcColumn[4*p + bases[p]];
+		}
+		if constexpr (quantised)
+		{
+			element.CheckElement(forward,rc,Precomputers[group][j]);
+		}
+		else
+		{
+			element.CheckElement(forward/L,rc/L,Precomputers[group][j]);
+		}
+	}
+}
+
+//a lazy table holds each entry XORed with the empty entry, so that the zero bytes of untouched pages read as "not yet computed". No computed entry is empty, since every group holds at least one motif
+template<class Element>
+using ElementBits = std::conditional_t<sizeof(Element) == 8,uint64_t,uint32_t>;
+
+template<class Element>
+inline Element SequenceScanner::Entry(HugePageArray<Element> & table, int group, size_t index) const
+{
+	if (!Lazy)
+	{
+		return table[index];
+	}
+	//entries are published with a single relaxed atomic store: they are self-contained, and any two threads which race compute the same value
+	using Bits = ElementBits<Element>;
+	const Bits empty = std::bit_cast<Bits>(Element());
+	Element stored;
+	__atomic_load(&table[index],&stored,__ATOMIC_RELAXED);
+	Bits raw = std::bit_cast<Bits>(stored);
+	if (raw == 0) [[unlikely]]
+	{
+		Element computed;
+		ComputeEntry(group,index,computed);
+		stored = std::bit_cast<Element>(std::bit_cast<Bits>(computed) ^ empty);
+		__atomic_store(&table[index],&stored,__ATOMIC_RELAXED);
+		return computed;
+	}
+	return std::bit_cast<Element>(raw ^ empty);
+}
+
+template<bool quantised, class Check>
+void SequenceScanner::CheckTied(int group, size_t index, bool flipped, Check check) const
+{
+	using Sum = std::conditional_t<quantised,fixedscore,double>;
+	auto & columns = [&]() -> auto & {
+		if constexpr (quantised)
+		{
+			return QuantisedGroupColumns[group];
+		}
+		else
+		{
+			return GroupColumns[group];
+		}
+	}();
+	const int L = PrecomputedSizes[group];
+	dnabits code = Canonical ? Indexers[group].Code(index) : index;
+	unsigned char bases[8*sizeof(dnabits)/Sequence::LogAlphabetSize];
+	for (int p = L - 1; p >= 0; --p)
+	{
+		bases[p] = code & Sequence::BitHackExtractor;
+		code = code >> Sequence::LogAlphabetSize;
+	}
+	//a flipped entry holds the reverse complement of the k-mer in the read
+	if (flipped)
+	{
+		std::reverse(bases,bases + L);
+		for (int p = 0; p < L; ++p)
+		{
+			bases[p] ^= Sequence::BitHackExtractor;
+		}
+	}
+
+	//each motif is summed position by position, as in a MotifBank, and checked as an on-the-fly motif would be
+	for (size_t j = 0; j < Precomputers[group].size(); ++j)
+	{
+		const Sum * forwardColumn = &columns[8*L*j];
+		const Sum * rcColumn = forwardColumn + 4*L;
+		Sum forward = 0;
+		Sum rc = 0;
+		for (int p = 0; p < L; ++p)
+		{
+			forward += forwardColumn[4*p + bases[p]];
+			rc += rcColumn[4*p + bases[p]];
+		}
+		double fscore = forward;
+		double rcscore = rc;
+		if constexpr (!quantised)
+		{
+			fscore /= L;
+			rcscore /= L;
+		}
+		check(Precomputers[group][j],fscore,Direction::Forward);
+		check(Precomputers[group][j],rcscore,Direction::Backward);
+	}
+}
+
+template<class Element>
+void SequenceScanner::FillTable(HugePageArray<Element> & table, int motifID, int L, const Sequence::CanonicalIndexer * indexer, size_t start, size_t end)
+{
+	constexpr bool quantised = std::is_same_v<Element,QuantisedElement>;
+	using Sum = std::conditional_t<quantised,fixedscore,double>;
+	std::vector<Sum> forwardColumn(4*L);
+	std::vector<Sum> rcColumn(4*L);
+	MotifColumns(motifID,L,forwardColumn.data(),rcColumn.data());
+
+	//Entries are filled a block at a time. Within a block, the entries of each slot (the centres, for canonical tables) differ only in their final m bases, so the scores of the shared prefix are computed once, and then extended one base at a time, with each partial sum spawning its 4 children.
+	const int m = tailBases(L,indexer);
+	const size_t nSlots = indexer ? indexer->Slots() : 1;
+	const size_t nTails = static_cast<size_t>(1) << (Sequence::LogAlphabetSize * m);
+	std::vector<Sum> forward(nTails), rc(nTails), nextForward(nTails), nextRC(nTails);
+	for (size_t blockStart = start; blockStart < end; blockStart += nSlots * nTails)
+	{
+		for (size_t slot = 0; slot < nSlots; ++slot)
+		{
+			dnabits code = indexer ? indexer->Code(blockStart + slot) : blockStart;
+			dnabits decoder = code >> (Sequence::LogAlphabetSize * m);
+			Sum fprefix = 0;
+			Sum rcprefix = 0;
+			for (int p = L - m - 1; p >= 0; --p)
+			{
+				int base = decoder & Sequence::BitHackExtractor;
+				decoder = decoder >> Sequence::LogAlphabetSize;
+				fprefix += forwardColumn[4*p + base];
+				rcprefix += rcColumn[4*p + base];
+			}
+
+			forward[0] = fprefix;
+			rc[0] = rcprefix;
+			size_t count = 1;
+			for (int p = L - m; p < L; ++p)
+			{
+				const Sum * fc = &forwardColumn[4*p];
+				const Sum * rcc = &rcColumn[4*p];
+				Sum * __restrict nf = nextForward.data();
+				Sum * __restrict nr = nextRC.data();
+				const Sum * __restrict f = forward.data();
+				const Sum * __restrict r = rc.data();
+				for (size_t c = 0; c < count; ++c)
+				{
+					for (int b = 0; b < 4; ++b)
+					{
+						nf[4*c + b] = f[c] + fc[b];
+						nr[4*c + b] = r[c] + rcc[b];
+					}
+				}
+				std::swap(forward,nextForward);
+				std::swap(rc,nextRC);
+				count *= 4;
+			}
+
+			//this is where the magic happens. We compute both the forward and rc score, and then check them against the scores achieved by *all of the motifs in the set*.
+			//We then store the winner. We then only need to do a single lookup for each subsequence to learn the best-scoring motif, and the best-scoring direction
+			for (size_t c = 0; c < nTails; ++c)
+			{
+				auto & element = table[blockStart + c * nSlots + slot];
+				if constexpr (quantised)
+				{
+					//quantised log-odds are already divided by L
+					element.CheckElement(forward[c],rc[c],motifID);
+				}
+				else
+				{
+					element.CheckElement(forward[c]/L,rc[c]/L,motifID);
+				}
+			}
+		}
+	}
+}
+
+void SequenceScanner::PrepareSweep()
+{
+	LongestGroup = 0;
+	for (int L : PrecomputedSizes)
+	{
+		LongestGroup = std::max(LongestGroup,L);
+	}
+	LongestMask = windowMask(LongestGroup);
+	SplitMask = windowMask(SplitWidth);
+	GroupMasks.resize(0);
+	GroupRCShifts.resize(0);
+	for (int L : PrecomputedSizes)
+	{
+		GroupMasks.push_back(windowMask(L));
+		GroupRCShifts.push_back(Sequence::LogAlphabetSize * (LongestGroup - L));
+	}
+
+	//bounds are in the units of Record::Score
+	auto bound = [&](int motifID) -> double {
+		return Quantised ? Motifs[motifID].MaximumQuantisedScore() : Motifs[motifID].MaximumScore();
+	};
+	auto sortByBound = [](std::vector<double> & bounds, std::vector<int> & order){
+		order.resize(bounds.size());
+		std::iota(order.begin(),order.end(),0);
+		std::stable_sort(order.begin(),order.end(),[&](int a, int b){return bounds[a] > bounds[b];});
+		std::vector<double> sorted;
+		for (int k : order)
+		{
+			sorted.push_back(bounds[k]);
+		}
+		bounds = sorted;
+	};
+
+	//fliers with split tables are looked up one at a time; the rest are fused into banks of equal length (see MotifBank), each holding motifs of similar bound
+	std::vector<int> split;
+	std::vector<int> banked;
+	for (size_t i = 0; i < Fliers.size(); ++i)
+	{
+		(Splits[i].Widths.size() > 0 ? split : banked).push_back(i);
+	}
+	FlierBounds.resize(0);
+	for (int i : split)
+	{
+		FlierBounds.push_back(bound(Fliers[i]));
+	}
+	sortByBound(FlierBounds,FlierOrder);
+	for (int & k : FlierOrder)
+	{
+		k = split[k];
+	}
+
+	std::stable_sort(banked.begin(),banked.end(),[&](int a, int b){
+		int La = Motifs[Fliers[a]].size();
+		int Lb = Motifs[Fliers[b]].size();
+		return (La != Lb) ? La < Lb : bound(Fliers[a]) > bound(Fliers[b]);
+	});
+	auto fillBanks = [&](auto & banks, auto weights){
+		banks.clear();
+		for (int i : banked)
+		{
+			int L = Motifs[Fliers[i]].size();
+			if (banks.size() == 0 || banks.back().Length != L || banks.back().Full())
+			{
+				banks.emplace_back(L);
+			}
+			banks.back().Add(weights(Motifs[Fliers[i]]),i,bound(Fliers[i]));
+		}
+		std::stable_sort(banks.begin(),banks.end(),[](auto & a, auto & b){return a.Bound > b.Bound;});
+	};
+	if (Quantised)
+	{
+		fillBanks(QuantisedBanks,[](const MotifMatrix & motif){return motif.ReferenceQuantisedScores();});
+	}
+	else
+	{
+		fillBanks(Banks,[](const MotifMatrix & motif){
+			std::vector<double> weights;
+			for (auto & column : motif.ReferenceScores())
+			{
+				weights.insert(weights.end(),column.begin(),column.end());
+			}
+			return weights;
+		});
+	}
+	//banks of the same length share a memo group; since k-mers are keyed by their code, only lengths within the encoding limit can be memoised
+	auto groupBanks = [&](auto & banks){
+		MemoGroups.clear();
+		MemoisedBanks.assign(banks.size(),false);
+		MemoMask = 0;
+		if (MemoBytes == 0)
+		{
+			return;
+		}
+		int longest = 0;
+		for (size_t b = 0; b < banks.size(); ++b)
+		{
+			int L = banks[b].Length;
+			if (L > (int)Sequence::MaximumEncodingLength())
+			{
+				continue;
+			}
+			auto group = std::find_if(MemoGroups.begin(),MemoGroups.end(),[&](auto & g){return g.Length == L;});
+			if (group == MemoGroups.end())
+			{
+				MemoGroups.push_back({L,windowMask(L),banks[b].Bound,{}});
+				group = MemoGroups.end() - 1;
+			}
+			group->Banks.push_back(b);
+			group->Bound = std::max(group->Bound,banks[b].Bound);
+			MemoisedBanks[b] = true;
+			longest = std::max(longest,L);
+		}
+		std::stable_sort(MemoGroups.begin(),MemoGroups.end(),[](auto & a, auto & b){return a.Bound > b.Bound;});
+		MemoMask = windowMask(longest);
+	};
+	if (Quantised)
+	{
+		groupBanks(QuantisedBanks);
+	}
+	else
+	{
+		groupBanks(Banks);
+	}
+
+	if (banked.size() > 0)
+	{
+		LOG(INFO) << banked.size() << " on-the-fly arrays fused into " << (Quantised ? QuantisedBanks.size() : Banks.size()) << " banks, scored with the " << (Quantised ? MotifBank<fixedscore>::Kernel() : MotifBank<double>::Kernel()) << " kernel";
+	}
+
+	GroupBounds.resize(0);
+	for (auto & group : Precomputers)
+	{
+		double groupBound = -std::numeric_limits<double>::infinity();
+		for (int id : group)
+		{
+			groupBound = std::max(groupBound,bound(id));
+		}
+		GroupBounds.push_back(groupBound);
+	}
+	sortByBound(GroupBounds,GroupOrder);
+
+	//only the tables which are too large to stay in cache are worth prefetching from. In sorted-lookup mode, those lookups are instead deferred (see ScanBlock)
+	PrefetchGroups.resize(0);
+	DeferredGroups.assign(PrecomputedSizes.size(),false);
+	for (size_t g = 0; g < PrecomputedSizes.size(); ++g)
+	{
+		size_t entries = Quantised ? QuantisedScores[g].size() : PrecomputedScores[g].size();
+		size_t bytes = entries * (Quantised ? sizeof(QuantisedElement) : sizeof(PrecomputeElement));
+		if (bytes > PrefetchTableSize)
+		{
+			//the deferred lookups hold 32-bit indices
+			if (SortedLookupMode && entries <= std::numeric_limits<uint32_t>::max())
+			{
+				DeferredGroups[g] = true;
+			}
+			else
+			{
+				PrefetchGroups.push_back(g);
+			}
+		}
+	}
+
+	//a motif must still be checked if it could tie with the best, since ties are counted. Quantised scores are exact; otherwise the margin covers the rounding of every score to float before it is checked (see Record), and summation order
+	BoundMargin = Quantised ? 0 : 1e-6;
+}
+
+//ties are resolved in favour of the lowest motif ID, then the earliest position, forward before backward; this depends only on the motifs, and not on which of them are precomputed
+uint64_t inline checkOrder(int motifID, int position, int strand)
+{
+	return (static_cast<uint64_t>(motifID) << 32) | (static_cast<uint64_t>(position) << 1) | strand;
+}
+
+FlierMemo & SequenceScanner::LocalMemo()
+{
+	//each thread has its own cache, created on first use; the scanner keeps them all, so that it can report on them
+	thread_local const SequenceScanner * owner = nullptr;
+	thread_local FlierMemo * memo = nullptr;
+	if (owner != this)
+	{
+		std::lock_guard<std::mutex> lock(MemoLock);
+		Memos.push_back(std::make_unique<FlierMemo>(MemoBytes));
+		memo = Memos.back().get();
+		owner = this;
+	}
+	return *memo;
+}
+
+template<class Sum>
+MemoResult SequenceScanner::MemoMiss(const std::vector<MotifBank<Sum>> & banks, const MemoGroup & group, const unsigned char * bases, int stride) const
+{
+	Sum forwardSums[BankLanes];
+	Sum rcSums[BankLanes];
+
+	//every motif of the group is scored in full (no threshold or pruning, since the result must serve any later read), and checked into an empty record in the same order as the banks would be, so that near-ties (e.g. the two strands of a palindrome) settle the same way
+	Record checks;
+	checks.Reset();
+	for (int b : group.Banks)
+	{
+		auto & bank = banks[b];
+		bank.Score(bases,std::numeric_limits<Sum>::lowest(),false,forwardSums,rcSums,stride);
+		for (int lane = 0; lane < bank.Size; ++lane)
+		{
+			double fscore = forwardSums[lane];
+			double rcscore = rcSums[lane];
+			if constexpr (!std::is_same_v<Sum,fixedscore>)
+			{
+				fscore /= bank.Length;
+				rcscore /= bank.Length;
+			}
+			int id = Fliers[bank.Fliers[lane]];
+			checks.CheckRecords(id,fscore,0,Direction::Forward,checkOrder(id,0,0));
+			checks.CheckRecords(id,rcscore,0,Direction::Backward,checkOrder(id,0,1));
+		}
+	}
+	return MemoResult{checks.Score,static_cast<uint32_t>(checks.MotifID),static_cast<uint8_t>(checks.Strand),static_cast<uint16_t>(checks.Hits)};
+}
+
+void SequenceScanner::ReportMemo() const
+{
+	std::lock_guard<std::mutex> lock(MemoLock);
+	if (Memos.size() == 0)
+	{
+		return;
+	}
+	size_t hits = 0;
+	size_t lookups = 0;
+	for (auto & memo : Memos)
+	{
+		hits += memo->Hits;
+		lookups += memo->Hits + memo->Misses;
+	}
+	LOG(INFO) << "On-the-fly memo: " << hits << " hits from " << lookups << " lookups (" << std::setprecision(3) << 100.0 * hits / std::max((size_t)1,lookups) << "%), across " << Memos.size() << " caches of " << Memos[0]->Capacity() << " entries";
+}
 
 void SequenceScanner::Scan(Sequence::DNA & dna, Record & best)
 {
-	//it's important that firstCheck is only active once, because it force-resets the record.
-	//Need to be careful on scans with mixed fly/precomp sets!
+	//a single read is scanned as a batch of one
+	thread_local Sequence::ReadBatch batch;
+	batch.Clear();
+	best.Reset();
+	if (batch.Add(dna.SequenceString))
+	{
+		ScanBatch(batch,&best);
+	}
+	dna.FileString.clear();
+	Format(best,dna.SequenceString,dna.FileString);
+}
+
+template<bool quantised, bool canonical>
+void SequenceScanner::SweepBatch(Sequence::ReadBatch & batch, BatchRecord & best, std::vector<SortedLookups> * deferred, int firstRead)
+{
+	typedef dnabits LaneCodes __attribute__((vector_size(Sequence::BatchLanes*sizeof(dnabits))));
+	const int lanes = Sequence::BatchLanes;
+	const int nSplit = FlierOrder.size();
+	const int nGroups = PrecomputedSizes.size();
+	const int rcTop = Sequence::LogAlphabetSize * (LongestGroup - 1);
+	auto & tables = LocalTables<quantised>();
+	auto & banks = [&]() -> auto & {
+		if constexpr (quantised)
+		{
+			return QuantisedBanks;
+		}
+		else
+		{
+			return Banks;
+		}
+	}();
+	using Sum = std::conditional_t<quantised,fixedscore,double>;
+	Sum forwardSums[BankLanes];
+	Sum rcSums[BankLanes];
+	LaneScores scores;
+	LaneInts motifs;
+	LaneInts strands;
+	LaneInts orders;
 
-	bool firstCheck = true;
-	//do the on the fly motifs first
-	for (int i = 0; i < Fliers.size(); ++i)
+	LaneInts lengths;
+	for (int lane = 0; lane < lanes; ++lane)
 	{
-		auto & motif = Motifs[Fliers[i]];
-		// auto & record = records[Fliers[i]];
-		int scanSize= dna.Length - motif.size() +1; 
-		for (int j = 0; j < scanSize; ++j)
+		//unused lanes have no length, so are never active
+		lengths[lane] = (lane < batch.Size) ? batch.Lengths[lane] : 0;
+	}
+
+	//every motif is checked in a single pass over the reads. window holds (for each read) the up to LongestGroup bases ending at position end, from which each group's code is masked, and rcWindow their reverse complement
+	LaneCodes window = {};
+	LaneCodes rcWindow = {};
+
+	//the memo groups are keyed on a rolling code of their own, since they may be longer than every precomputed group
+	const bool memoise = MemoGroups.size() > 0;
+	FlierMemo * memo = memoise ? &LocalMemo() : nullptr;
+	LaneCodes memoWindow = {};
+
+	//the split tables are looked up on the codes of the SplitWidth bases ending at each position; these are kept for the whole batch, since a motif's sub-windows end at several earlier positions
+	LaneCodes splitCode = {};
+	thread_local std::vector<LaneCodes> splitCodes;
+	if (SplitWidth > 0 && splitCodes.size() < static_cast<size_t>(batch.MaxLength))
+	{
+		splitCodes.resize(batch.MaxLength);
+	}
+
+	auto baseRow = [&](int position){
+		const unsigned char * row = &batch.Bases[position*lanes];
+		LaneCodes base;
+		for (int lane = 0; lane < lanes; ++lane)
+		{
+			base[lane] = row[lane];
+		}
+		return base;
+	};
+
+	//the lookups into large tables are random DRAM accesses, but the codes depend only on the reads: a second window runs PrefetchDistance positions ahead, so that those entries are already on their way to cache by the time they are needed
+	LaneCodes ahead = {};
+	LaneCodes rcAhead = {};
+	auto rollAhead = [&](int position){
+		LaneCodes base = baseRow(position);
+		ahead = ((ahead << Sequence::LogAlphabetSize) | base) & LongestMask;
+		if constexpr (canonical)
+		{
+			rcAhead = (rcAhead >> Sequence::LogAlphabetSize) | ((base ^ Sequence::BitHackExtractor) << rcTop);
+		}
+	};
+	const bool prefetch = PrefetchGroups.size() > 0 && !deferred;
+	if (prefetch)
+	{
+		for (int position = 0; position < std::min(PrefetchDistance,batch.MaxLength); ++position)
+		{
+			rollAhead(position);
+		}
+	}
+
+	for (int end = 0; end < batch.MaxLength; ++end)
+	{
+		LaneCodes base = baseRow(end);
+		window = ((window << Sequence::LogAlphabetSize) | base) & LongestMask;
+		if (SplitWidth > 0)
+		{
+			splitCode = ((splitCode << Sequence::LogAlphabetSize) | base) & SplitMask;
+			splitCodes[end] = splitCode;
+		}
+		if constexpr (canonical)
+		{
+			rcWindow = (rcWindow >> Sequence::LogAlphabetSize) | ((base ^ Sequence::BitHackExtractor) << rcTop);
+		}
+		if (memoise)
+		{
+			memoWindow = ((memoWindow << Sequence::LogAlphabetSize) | base) & MemoMask;
+		}
+		const LaneInts inRead = (LaneInts{} + end) < lengths;
+
+		const int future = end + PrefetchDistance;
+		if (prefetch && future < batch.MaxLength)
+		{
+			rollAhead(future);
+			for (int g : PrefetchGroups)
+			{
+				if (future + 1 < PrecomputedSizes[g])
+				{
+					continue;
+				}
+				LaneCodes codes = ahead & GroupMasks[g];
+				LaneCodes rcCodes = rcAhead >> GroupRCShifts[g];
+				for (int lane = 0; lane < batch.Size; ++lane)
+				{
+					if (future < batch.Lengths[lane])
+					{
+						dnabits code = codes[lane];
+						if constexpr (canonical)
+						{
+							bool flipped;
+							code = Indexers[g].Index(code,rcCodes[lane],flipped);
+						}
+						__builtin_prefetch(&tables[g][code]);
+					}
+				}
+			}
+		}
+
+		//motifs whose bound falls short of the best so far can neither beat nor tie with it. Since they are visited in descending order of bound, the first such motif ends the loop; if no motif remains, neither does the rest of the batch. A motif is skipped only once its bound falls short of the best in every read still being scanned
+		double cutoff = std::numeric_limits<double>::infinity();
+		for (int lane = 0; lane < batch.Size; ++lane)
+		{
+			if (inRead[lane])
+			{
+				cutoff = std::min(cutoff,(best.Hits[lane] == 0) ? -std::numeric_limits<double>::infinity() : best.Score[lane] - BoundMargin);
+			}
+		}
+		if ((banks.size() == 0 || banks[0].Bound < cutoff) && (nSplit == 0 || FlierBounds[0] < cutoff) && (nGroups == 0 || GroupBounds[0] < cutoff))
+		{
+			break;
+		}
+
+		for (size_t m = 0; m < MemoGroups.size() && MemoGroups[m].Bound >= cutoff; ++m)
+		{
+			auto & group = MemoGroups[m];
+			int start = end + 1 - group.Length;
+			if (start < 0)
+			{
+				continue;
+			}
+			LaneCodes codes = memoWindow & group.Mask;
+			for (int lane = 0; lane < batch.Size; ++lane)
+			{
+				if (!inRead[lane])
+				{
+					continue;
+				}
+				MemoResult result;
+				if (!memo->Find(codes[lane],m,result))
+				{
+					result = MemoMiss(banks,group,&batch.Bases[start*lanes + lane],lanes);
+					memo->Insert(codes[lane],m,result);
+				}
+				for (int t = 0; t < result.Ties; ++t)
+				{
+					best.CheckLane(lane,result.MotifID,result.Score,start,(Direction)result.Strand,checkOrder(result.MotifID,start,result.Strand));
+				}
+			}
+		}
+
+		for (size_t b = 0; b < banks.size(); ++b)
+		{
+			auto & bank = banks[b];
+			if (bank.Bound < cutoff)
+			{
+				break;
+			}
+			int start = end + 1 - bank.Length;
+			if (start < 0 || (memoise && MemoisedBanks[b]))
+			{
+				continue;
+			}
+			//each read is scored against every motif of the bank at once. Lanes which fall short of the threshold can neither beat nor tie with the best, so are only checked if the kernel says one of them might
+			for (int lane = 0; lane < batch.Size; ++lane)
+			{
+				if (!inRead[lane])
+				{
+					continue;
+				}
+				//the kernels work on unnormalised sums. In double mode the margin is wider than the tie tolerance of Record::CheckRecords, plus any difference in rounding
+				Sum threshold = std::numeric_limits<Sum>::lowest();
+				if (best.Hits[lane] > 0)
+				{
+					if constexpr (quantised)
+					{
+						threshold = static_cast<fixedscore>(best.Score[lane]);
+					}
+					else
+					{
+						threshold = (best.Score[lane] - BoundMargin) * bank.Length;
+					}
+				}
+				if (bank.Score(&batch.Bases[start*lanes + lane],threshold,Prune,forwardSums,rcSums,lanes))
+				{
+					for (int m = 0; m < bank.Size; ++m)
+					{
+						int id = Fliers[bank.Fliers[m]];
+						double fscore = forwardSums[m];
+						double rcscore = rcSums[m];
+						if constexpr (!quantised)
+						{
+							fscore /= bank.Length;
+							rcscore /= bank.Length;
+						}
+						best.CheckLane(lane,id,fscore,start,Direction::Forward,checkOrder(id,start,0));
+						best.CheckLane(lane,id,rcscore,start,Direction::Backward,checkOrder(id,start,1));
+					}
+				}
+			}
+		}
+
+		for (int k = 0; k < nSplit && FlierBounds[k] >= cutoff; ++k)
+		{
+			int i = FlierOrder[k];
+			int L = Motifs[Fliers[i]].size();
+			int start = end + 1 - L;
+			if (start < 0)
+			{
+				continue;
+			}
+			auto & split = Splits[i];
+			LaneScores fscores = {};
+			LaneScores rcscores = {};
+			for (int lane = 0; lane < batch.Size; ++lane)
+			{
+				int subEnd = start - 1;
+				for (size_t c = 0; c < split.Widths.size(); ++c)
+				{
+					subEnd += split.Widths[c];
+					auto & partial = split.Partials[c][splitCodes[subEnd][lane] & split.Masks[c]];
+					fscores[lane] += partial.first;
+					rcscores[lane] += partial.second;
+				}
+			}
+			if constexpr (!quantised)
+			{
+				fscores /= L;
+				rcscores /= L;
+			}
+			const int id = Fliers[i];
+			best.CheckLanes(inRead,fscores,LaneInts{} + id,LaneInts{} + start,LaneInts{} + (int64_t)Direction::Forward,LaneInts{} + (int64_t)checkOrder(id,start,0));
+			best.CheckLanes(inRead,rcscores,LaneInts{} + id,LaneInts{} + start,LaneInts{} + (int64_t)Direction::Backward,LaneInts{} + (int64_t)checkOrder(id,start,1));
+		}
+
+		for (int k = 0; k < nGroups && GroupBounds[k] >= cutoff; ++k)
 		{
-			
-			auto[fscore,rcscore] = motif.Score(dna,j);
-			best.CheckRecords(Fliers[i],fscore,j,Direction::Forward,firstCheck);
-			firstCheck = false;
-			best.CheckRecords(Fliers[i],rcscore,j,Direction::Backward,false);
+			int g = GroupOrder[k];
+			int start = end + 1 - PrecomputedSizes[g];
+			if (start < 0)
+			{
+				continue;
+			}
+			LaneCodes codes = window & GroupMasks[g];
+			LaneCodes rcCodes = rcWindow >> GroupRCShifts[g];
+			if (deferred && DeferredGroups[g])
+			{
+				//left to be resolved in page order, see ScanBlock
+				for (int lane = 0; lane < batch.Size; ++lane)
+				{
+					if (inRead[lane])
+					{
+						dnabits code = codes[lane];
+						bool flipped = false;
+						if constexpr (canonical)
+						{
+							code = Indexers[g].Index(code,rcCodes[lane],flipped);
+						}
+						(*deferred)[g].Add(code,firstRead + lane,start,flipped);
+					}
+				}
+				continue;
+			}
+			LaneInts tied = {};
+			for (int lane = 0; lane < batch.Size; ++lane)
+			{
+				dnabits code = codes[lane];
+				bool flipped = false;
+				if constexpr (canonical)
+				{
+					code = Indexers[g].Index(code,rcCodes[lane],flipped);
+				}
+				auto pre = Entry(tables[g],g,code);
+				scores[lane] = pre.Score;
+				motifs[lane] = pre.MotifID;
+				strands[lane] = pre.Strand ^ flipped;
+				orders[lane] = checkOrder(pre.MotifID,start,strands[lane]);
+				if (pre.Tied && inRead[lane])
+				{
+					tied[lane] = -1;
+					CheckTied<quantised>(g,code,flipped,[&](int id, double score, Direction dir){
+						best.CheckLane(lane,id,score,start,dir,checkOrder(id,start,dir));
+					});
+				}
+			}
+			best.CheckLanes(inRead & ~tied,scores,motifs,LaneInts{} + start,strands,orders);
 		}
 	}
+}
 
+void SequenceScanner::SweepBatch(Sequence::ReadBatch & batch, Record * records, std::vector<SortedLookups> * deferred, int firstRead)
+{
+	BatchRecord best;
+	best.Reset();
+	if (Quantised)
+	{
+		Canonical ? SweepBatch<true,true>(batch,best,deferred,firstRead) : SweepBatch<true,false>(batch,best,deferred,firstRead);
+	}
+	else
+	{
+		Canonical ? SweepBatch<false,true>(batch,best,deferred,firstRead) : SweepBatch<false,false>(batch,best,deferred,firstRead);
+	}
+	for (int lane = 0; lane < batch.Size; ++lane)
+	{
+		records[lane] = best.Lane(lane);
+	}
+}
+
+void SequenceScanner::ScanBatch(Sequence::ReadBatch & batch, Record * records)
+{
+	SweepBatch(batch,records,nullptr,0);
+}
 
-	//then do the precomputes
-	for (int i = 0; i < Precomputers.size(); ++i)
+void SequenceScanner::ScanBlock(std::vector<Sequence::ReadBatch> & batches, int nBatches, Record * records)
+{
+	if (!SortedLookupMode)
 	{
-		int L = PrecomputedSizes[i];
-		dna.SetBitfield(L,0);
-		int scanSize= dna.Length - L +1; 
-		for (int j = 0; j < scanSize; ++j)
+		for (int b = 0; b < nBatches; ++b)
 		{
-			dnabits pos = dna.GetBitfield();
+			ScanBatch(batches[b],records + b*Sequence::BatchLanes);
+		}
+		return;
+	}
 
-			auto pre = PrecomputedScores[i][pos];
-			best.CheckRecords(pre.MotifID,pre.Score,j,pre.Strand,firstCheck);
-			firstCheck = false;
+	//every lookup into a large table is deferred until the whole block has been swept, and then made in page order
+	thread_local std::vector<SortedLookups> deferred;
+	deferred.resize(PrecomputedSizes.size());
+	for (auto & lookups : deferred)
+	{
+		lookups.Clear();
+	}
+	for (int b = 0; b < nBatches; ++b)
+	{
+		SweepBatch(batches[b],records + b*Sequence::BatchLanes,&deferred,b*Sequence::BatchLanes);
+	}
 
-			if (j < scanSize - 1) // on all but the last step
+	auto resolve = [&](auto & tables, size_t elementSize, auto quantised){
+		for (size_t g = 0; g < PrecomputedSizes.size(); ++g)
+		{
+			if (!DeferredGroups[g])
 			{
-				dna.StepBitfield();
+				continue;
 			}
+			auto & table = tables[g];
+			int indexBits = std::bit_width(table.size() - 1);
+			int pageShift = std::bit_width(SortedLookupPageSize / elementSize) - 1;
+			deferred[g].Sort(pageShift,indexBits);
+			deferred[g].ForEach([&](uint32_t index, uint32_t read, int position, bool flipped){
+				auto pre = Entry(table,g,index);
+				if (pre.Tied)
+				{
+					CheckTied<decltype(quantised)::value>(g,index,flipped,[&](int id, double score, Direction dir){
+						records[read].CheckRecords(id,score,position,dir,checkOrder(id,position,dir));
+					});
+					return;
+				}
+				Direction strand = (Direction)(pre.Strand ^ flipped);
+				records[read].CheckRecords(pre.MotifID,pre.Score,position,strand,checkOrder(pre.MotifID,position,strand));
+			});
 		}
+	};
+	if (Quantised)
+	{
+		resolve(LocalTables<true>(),sizeof(QuantisedElement),std::true_type{});
+	}
+	else
+	{
+		resolve(LocalTables<false>(),sizeof(PrecomputeElement),std::false_type{});
 	}
-	int L = Motifs[best.MotifID].size();
-	format_to_string(dna.FileString,"%s %d %d %d %s %d %f",std::string(dna.SequenceString.begin()+best.Position,dna.SequenceString.begin()+best.Position+L), best.MotifID,best.Position,best.Position+L, directionString(best.Strand),best.Hits,best.Score);
 }
 
+void SequenceScanner::Format(const Record & best, std::string_view sequence, std::string & out) const
+{
+	if (best.Hits == 0)
+	{
+		//the read is shorter than every motif
+		out.append("- -1 -1 -1 ? 0 nan");
+		return;
+	}
+
+	//written with to_chars rather than printf, which must parse the format string (twice) for every read. The score is correctly rounded to 6 decimal places, just as %f would be
+	int L = Motifs[best.MotifID].size();
+	char buffer[128];
+	char * end = buffer + sizeof(buffer);
+	auto append = [&](auto value){
+		char * tail = std::to_chars(buffer,end,value).ptr;
+		out.append(buffer,tail - buffer);
+	};
+	out.append(sequence.substr(best.Position,L));
+	out += ' ';
+	append(best.MotifID);
+	out += ' ';
+	append(best.Position);
+	out += ' ';
+	append(best.Position + L);
+	out += ' ';
+	out.append(directionString(best.Strand));
+	out += ' ';
+	append(best.Hits);
+	out += ' ';
+	char * tail = std::to_chars(buffer,end,best.Score*ScoreUnit,std::chars_format::fixed,6).ptr;
+	out.append(buffer,tail - buffer);
+}
@@ -1,19 +1,67 @@
 #pragma once
 #include "../biology/MotifMatrix.h"
 #include "ScanRecord.h"
+#include "MotifBank.h"
+#include "SortedLookups.h"
+#include "TableCache.h"
+#include "FlierMemo.h"
+#include "InputSampler.h"
+#include "../parallel/parallel.h"
+#include "../tools/hugePageArray.h"
 #include <filesystem>
+#include <memory>
+#include <mutex>
 
 using fs_path = std::filesystem::directory_entry;
 
+/*!
+	@brief Partial-score tables for a single long motif, which is scored as the sum of lookups over consecutive sub-windows (see -split)
+	@details Unlike the precomputed tables, these hold per-motif (forward, reverse-complement) partial scores rather than a pre-reduced winner, since the best motif can only be decided on the summed score. The partials are held as floats, 8 bytes per code: in quantised mode they are whole numbers of resolution steps (which a float holds exactly), and otherwise they are rounded as the precomputed scores are.
+*/
+struct SplitTable
+{
+	typedef std::pair<float,float> Partial;
+	std::vector<int> Widths; //!< The number of bases in each sub-window; all but the last are the split width
+	std::vector<dnabits> Masks; //!< Selects the final Widths[c] bases of a split-width code
+	std::vector<std::vector<Partial>> Partials; //!< Indexed [sub-window][code]
+
+	//! The size of the tables of a motif of length L, split into sub-windows of the given width
+	static size_t Bytes(int L, int width);
+};
+
+const size_t PrecomputeTileSize = 1<<13; //the number of table entries filled by all the motifs of a group before moving on; small enough to stay in L1/L2 cache
+const size_t PrefetchTableSize = 1<<20; //tables larger than this (in bytes) are assumed not to fit in cache, and their entries are prefetched ahead of use
+const int PrefetchDistance = 4; //the number of positions ahead of the scan at which table entries are prefetched
+const size_t SortedLookupPageSize = 4096; //in sorted-lookup mode, lookups are sorted to the granularity of this many bytes of table
+
 class SequenceScanner
 {
 	public:
 		// std::vector<MotifMatrix> OnTheFly;
 		// std::vector<std::vector<MotifMatrix>> Precomputed;
-		SequenceScanner(std::vector<fs_path> motifPaths, int sequenceCount=Settings.Input.EstimatedReadCount,int sequenceLength=Settings.Input.EstimatedReadLength);
+		SequenceScanner(std::vector<fs_path> motifPaths, ParallelPool & pool, const InputEstimate & input = InputEstimate::FromSettings());
 		
+		//! Scans a single read, as a batch of one (see ScanBatch), and formats the result into dna.FileString
 		void Scan(Sequence::DNA & dna, Record & record);
+
+		/*!
+			@brief Scans every read of a batch at once, writing the result for read i to records[i]
+			@details The rolling codes, the motif scores and the record checks are all made for every read in the batch at once, as vectors with one lane per read (see BatchRecord). Each read's result depends only on that read, not on the others in its batch.
+		*/
+		void ScanBatch(Sequence::ReadBatch & batch, Record * records);
+
+		/*!
+			@brief Scans a block of batches, writing the results for read i of batch b to records[b*Sequence::BatchLanes + i]. Every batch but the last must be full.
+			@details Identical to calling ScanBatch() on each batch, unless -sorted-lookups is set: the lookups into large tables are then collected for the whole block, sorted by address (see SortedLookups), and made in a single sweep through each table.
+		*/
+		void ScanBlock(std::vector<Sequence::ReadBatch> & batches, int nBatches, Record * records);
+
+		//! Appends the output line for a scanned read (without its ID) to out
+		void Format(const Record & record, std::string_view sequence, std::string & out) const;
 		size_t size() const;
+
+		//! Logs the hit rate of the on-the-fly memo caches (see -memo), if there are any
+		void ReportMemo() const;
 		private:
 		std::vector<std::vector<int>> Precomputers;
 		std::vector<int> PrecomputedSizes;
@@ -22,10 +70,99 @@ class SequenceScanner
 		int NMotifs;
 		
 		//first index groups motifs of the same length (small, < 5)
-		//second index is the dnabits encoding 
-		std::vector<std::vector<PrecomputeElement>> PrecomputedScores;
-		void InitialiseMotifs(int sequenceCount, int sequenceLength);
-		void Precompute();
+		//second index is the dnabits encoding. The tables are backed by huge pages where possible (see HugePageArray), since random lookups into them would otherwise miss the TLB on almost every access
+		bool HugePages;
+		std::vector<HugePageArray<PrecomputeElement>> PrecomputedScores;
+
+		//the quantised mode (see MotifMatrix::Quantise) uses these tables in place of PrecomputedScores, and reports scores in units of ScoreUnit
+		bool Quantised;
+		double ScoreUnit;
+		std::vector<HugePageArray<QuantisedElement>> QuantisedScores;
+
+		//with -numa-tables 2, every NUMA node but the first has its own copy of the tables, indexed [node-1][group]; each thread reads those of the node it is pinned to (see LocalTables)
+		bool Replicate;
+		std::vector<std::vector<HugePageArray<PrecomputeElement>>> PrecomputedReplicas;
+		std::vector<std::vector<HugePageArray<QuantisedElement>>> QuantisedReplicas;
+
+		//in canonical mode (see Sequence::CanonicalIndexer) the tables are indexed through these, one per length group
+		bool Canonical;
+		std::vector<Sequence::CanonicalIndexer> Indexers;
+
+		//on-the-fly motifs longer than SplitWidth have tables here (parallel to Fliers; empty for motifs scored directly), and are looked up on a rolling code of SplitWidth bases. Zero if the plan has no room for them (see PrecomputePlan)
+		int SplitWidth;
+		dnabits SplitMask;
+		std::vector<SplitTable> Splits;
+
+		//the on-the-fly motifs without split tables, fused into banks which are scored with a single SIMD kernel (see MotifBank). Sorted by descending bound
+		std::vector<MotifBank<double>> Banks;
+		std::vector<MotifBank<fixedscore>> QuantisedBanks;
+
+		//with -memo, the banks of each length (up to the encoding limit) form a memo group, whose results for each k-mer are cached by each thread (see FlierMemo). Sorted by descending bound
+		struct MemoGroup
+		{
+			int Length;
+			dnabits Mask;
+			double Bound;
+			std::vector<int> Banks;
+		};
+		size_t MemoBytes; //the size of each thread's cache
+		std::vector<MemoGroup> MemoGroups;
+		std::vector<bool> MemoisedBanks;
+		dnabits MemoMask;
+		mutable std::mutex MemoLock;
+		std::vector<std::unique_ptr<FlierMemo>> Memos;
+		FlierMemo & LocalMemo();
+		template<class Sum>
+		MemoResult MemoMiss(const std::vector<MotifBank<Sum>> & banks, const MemoGroup & group, const unsigned char * bases, int stride) const;
+
+		//if true, banks abandon a position as soon as none of their motifs can reach the running best
+		bool Prune;
+
+		//the single-pass scan keeps a rolling code of the longest precomputed window, from which each group's code is masked (and each group's reverse complement code is shifted)
+		int LongestGroup;
+		dnabits LongestMask;
+		std::vector<dnabits> GroupMasks;
+		std::vector<int> GroupRCShifts;
+		std::vector<int> PrefetchGroups; //the groups whose tables exceed PrefetchTableSize
+		bool SortedLookupMode;
+		std::vector<bool> DeferredGroups; //in sorted-lookup mode, the groups (in place of PrefetchGroups) whose lookups are deferred to the end of each block
+
+		//the split-table fliers and the groups in descending order of the greatest score they can attain (see MotifMatrix::MaximumScore), alongside those bounds, so that once a read has a good enough hit the remainder can be skipped
+		std::vector<int> FlierOrder;
+		std::vector<double> FlierBounds;
+		std::vector<int> GroupOrder;
+		std::vector<double> GroupBounds;
+		double BoundMargin;
+
+		void InitialiseMotifs(const InputEstimate & input, ParallelPool & pool);
+		void Precompute(ParallelPool & pool);
+		uint64_t TableKey(int group, size_t entries) const; //the key of a group's table in the TableCache
+		template<class Element>
+		void PlaceTables(std::vector<HugePageArray<Element>> & tables, ParallelPool & pool);
+		template<class Element>
+		void Replicas(const std::vector<HugePageArray<Element>> & tables, std::vector<std::vector<HugePageArray<Element>>> & replicas);
+		template<bool quantised>
+		auto & LocalTables(); //the tables (or replicas) local to the calling thread
+		//in lazy mode (see -lazy) the tables start empty, and each entry is computed from these columns (see MotifColumns) the first time it is looked up; they also re-score tied entries (see CheckTied). Indexed [group][(8*j + 4*strand)*L + 4*p + base] for the j-th motif of the group
+		bool Lazy;
+		std::vector<std::vector<double>> GroupColumns;
+		std::vector<std::vector<fixedscore>> QuantisedGroupColumns;
+		template<class Sum>
+		void MotifColumns(int motifID, int L, Sum * forwardColumn, Sum * rcColumn) const; //the contribution of base b at position p to the forward (and reverse complement) score, indexed [4*p + b]
+		template<class Element>
+		void ComputeEntry(int group, size_t index, Element & element) const;
+		template<class Element>
+		Element Entry(HugePageArray<Element> & table, int group, size_t index) const; //reads (or in lazy mode, if need be computes) an entry of a group's table
+		template<bool quantised, class Check>
+		void CheckTied(int group, size_t index, bool flipped, Check check) const; //makes check(motifID, score, strand) for every motif of a group at the k-mer of a tied entry, as an on-the-fly scan would, so that ties are counted and won by the same rule
+		template<class Element>
+		void FillTable(HugePageArray<Element> & table, int motifID, int L, const Sequence::CanonicalIndexer * indexer, size_t start, size_t end);
+		void BuildSplitTables(ParallelPool & pool);
+		void PrepareSweep();
+		template<bool quantised, bool canonical>
+		void SweepBatch(Sequence::ReadBatch & batch, BatchRecord & best, std::vector<SortedLookups> * deferred, int firstRead);
+
+		//sweeps a batch, deferring the lookups into DeferredGroups if deferred is not null; read i of the batch is read firstRead + i of the block
+		void SweepBatch(Sequence::ReadBatch & batch, Record * records, std::vector<SortedLookups> * deferred, int firstRead);
 };
 
-bool PrecomputationAllowed(size_t sequenceCount, size_t meanSize, size_t motifLength, int callingID);
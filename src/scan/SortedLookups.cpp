@@ -0,0 +1,58 @@
+#include "SortedLookups.h"
+#include <array>
+#include <algorithm>
+
+namespace
+{
+	const int DigitBits = 11; //the radix sort works through the key in digits of this many bits
+}
+
+void SortedLookups::Clear()
+{
+	Indices.clear();
+	Tags.clear();
+	Reads.clear();
+	Positions.clear();
+	Flipped.clear();
+}
+
+void SortedLookups::Add(uint32_t index, uint32_t read, int position, bool flipped)
+{
+	Tags.push_back(Indices.size());
+	Indices.push_back(index);
+	Reads.push_back(read);
+	Positions.push_back(position);
+	Flipped.push_back(flipped);
+}
+
+void SortedLookups::Sort(int pageShift, int indexBits)
+{
+	const size_t n = Indices.size();
+	IndexBuffer.resize(n);
+	TagBuffer.resize(n);
+	std::array<uint32_t,1<<DigitBits> offsets;
+	for (int shift = pageShift; shift < indexBits; shift += DigitBits)
+	{
+		const uint32_t digitMask = (1u << DigitBits) - 1;
+		offsets.fill(0);
+		for (size_t i = 0; i < n; ++i)
+		{
+			++offsets[(Indices[i] >> shift) & digitMask];
+		}
+		uint32_t sum = 0;
+		for (auto & offset : offsets)
+		{
+			uint32_t count = offset;
+			offset = sum;
+			sum += count;
+		}
+		for (size_t i = 0; i < n; ++i)
+		{
+			uint32_t target = offsets[(Indices[i] >> shift) & digitMask]++;
+			IndexBuffer[target] = Indices[i];
+			TagBuffer[target] = Tags[i];
+		}
+		std::swap(Indices,IndexBuffer);
+		std::swap(Tags,TagBuffer);
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*!
+	@brief Collects the table lookups of a block of reads, so that they can be made in ascending order of address rather than read-by-read
+	@details Lookups are sorted by the table page they fall on (see Sort), so that the table is swept from start to end, with each page (and its TLB entry) visited once. Each lookup is tagged with the read and position which required it, so that the results can be scattered back.
+*/
+class SortedLookups
+{
+	public:
+		//! Removes all lookups; the storage is kept for reuse
+		void Clear();
+
+		void Add(uint32_t index, uint32_t read, int position, bool flipped);
+
+		/*!
+			@brief A radix sort of the lookups on index >> pageShift, over the bits of an index up to indexBits
+			@details The order within a page is left as it was, since it makes no difference to the access pattern, and sorting on fewer bits saves passes.
+		*/
+		void Sort(int pageShift, int indexBits);
+
+		size_t Size() const {return Indices.size();};
+
+		//! Calls f(index, read, position, flipped) for each lookup, in sorted order
+		template<class Func>
+		void ForEach(Func f) const
+		{
+			for (size_t i = 0; i < Indices.size(); ++i)
+			{
+				uint32_t tag = Tags[i];
+				f(Indices[i],Reads[tag],Positions[tag],Flipped[tag]);
+			}
+		}
+	private:
+		std::vector<uint32_t> Indices;
+		std::vector<uint32_t> Tags; //the order in which each lookup was added, which indexes the arrays below
+		std::vector<uint32_t> Reads;
+		std::vector<int> Positions;
+		std::vector<uint8_t> Flipped;
+
+		std::vector<uint32_t> IndexBuffer;
+		std::vector<uint32_t> TagBuffer;
+};
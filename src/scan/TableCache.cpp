@@ -0,0 +1,132 @@
+#include "TableCache.h"
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../tools/Log.h"
+
+namespace
+{
+	const char Magic[8] = {'M','M','T','A','B','L','E','\0'};
+	const uint32_t CacheVersion = 2; //must be incremented whenever the layout of the table entries, or the way they are filled, changes
+
+	struct CacheHeader
+	{
+		char Magic[8];
+		uint32_t Version;
+		uint32_t Reserved;
+		uint64_t Key;
+		uint64_t Bytes;
+		uint64_t DataOffset; //the table starts on a page boundary, so that it can be mapped directly
+	};
+
+	size_t pageSize()
+	{
+		return std::max<size_t>(4096,sysconf(_SC_PAGESIZE));
+	}
+}
+
+void TableHash::Add(const void * data, size_t bytes)
+{
+	auto bytePtr = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		Hash ^= bytePtr[i];
+		Hash *= 0x100000001b3ull;
+	}
+}
+
+TableCache::TableCache(const std::string & directory) : Directory(directory)
+{
+	if (Enabled())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(Directory,error);
+		if (error)
+		{
+			LOG(WARN) << "Could not create the table cache '" << Directory << "' (" << error.message() << "); tables will not be cached";
+			Directory.clear();
+		}
+	}
+}
+
+std::string TableCache::Path(uint64_t key) const
+{
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0') << key << ".table";
+	return (std::filesystem::path(Directory) / name.str()).string();
+}
+
+bool TableCache::Load(uint64_t key, size_t bytes, HugePageBuffer & out) const
+{
+	if (!Enabled())
+	{
+		return false;
+	}
+	std::string path = Path(key);
+	int fd = open(path.c_str(),O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	CacheHeader header;
+	struct stat info;
+	bool valid = (read(fd,&header,sizeof(header)) == sizeof(header)) && (fstat(fd,&info) == 0);
+	valid = valid && std::memcmp(header.Magic,Magic,sizeof(Magic)) == 0 && header.Version == CacheVersion && header.Key == key && header.Bytes == bytes;
+	valid = valid && header.DataOffset % pageSize() == 0 && (size_t)info.st_size == header.DataOffset + bytes;
+	if (!valid)
+	{
+		close(fd);
+		LOG(WARN) << "The cached table '" << path << "' is incomplete or from another version, and will be rebuilt";
+		return false;
+	}
+	out = HugePageBuffer::MapFile(fd,header.DataOffset,bytes);
+	close(fd); //the mapping holds its own reference to the file
+	return true;
+}
+
+void TableCache::Store(uint64_t key, const void * data, size_t bytes) const
+{
+	if (!Enabled())
+	{
+		return;
+	}
+	std::string path = Path(key);
+	std::string temporary = path + ".tmp" + std::to_string(getpid());
+
+	CacheHeader header;
+	std::memcpy(header.Magic,Magic,sizeof(Magic));
+	header.Version = CacheVersion;
+	header.Reserved = 0;
+	header.Key = key;
+	header.Bytes = bytes;
+	header.DataOffset = pageSize();
+	std::vector<char> padding(header.DataOffset - sizeof(header),0);
+	{
+		std::ofstream file(temporary,std::ios::binary);
+		file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+		file.write(padding.data(),padding.size());
+		file.write(static_cast<const char*>(data),bytes);
+		if (!file)
+		{
+			LOG(WARN) << "Could not write the table cache file '" << temporary << "'";
+			file.close();
+			std::filesystem::remove(temporary);
+			return;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary,path,error);
+	if (error)
+	{
+		LOG(WARN) << "Could not move the table cache file into place at '" << path << "' (" << error.message() << ")";
+		std::filesystem::remove(temporary,error);
+	}
+}
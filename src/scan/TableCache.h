@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <type_traits>
+#include "../tools/hugePageArray.h"
+
+/*!
+	@brief A 64-bit FNV-1a hash, built up from the contents which determine a precomputed table
+*/
+class TableHash
+{
+	public:
+		void Add(const void * data, size_t bytes);
+
+		template<class T>
+		void Add(const T & value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>,"Only plain values can be hashed byte-by-byte");
+			Add(&value,sizeof(T));
+		}
+
+		uint64_t Value() const {return Hash;};
+	private:
+		uint64_t Hash = 0xcbf29ce484222325ull;
+};
+
+/*!
+	@brief A directory of precomputed tables, each held in a binary file named after the hash of its contents (see SequenceScanner::TableKey)
+	@details Since the key covers everything the table is computed from, a table is invalidated simply by its key changing: a modified PFM produces a new file, rather than overwriting the old one. Tables are written to a temporary file and then renamed, so concurrent processes never see a partial table, and are loaded as shared read-only mappings of the page cache (see HugePageBuffer::MapFile).
+*/
+class TableCache
+{
+	public:
+		//! If directory is empty, the cache is disabled
+		TableCache(const std::string & directory);
+
+		bool Enabled() const {return !Directory.empty();};
+
+		/*!
+			@brief Maps the table with this key into out
+			@returns False if there is no such table of exactly this many bytes (or if it is unreadable, in which case it is rebuilt)
+		*/
+		bool Load(uint64_t key, size_t bytes, HugePageBuffer & out) const;
+
+		//! Writes a table to the cache. Failures are reported but not fatal, since the table is already in memory
+		void Store(uint64_t key, const void * data, size_t bytes) const;
+
+		std::string Path(uint64_t key) const;
+	private:
+		std::string Directory;
+};
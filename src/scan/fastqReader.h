@@ -1,94 +1,296 @@
 #pragma once
 #include "filesystem"
-#include <streambuf>
+#include "../tools/gzipReader.h"
+#include "../tools/parallelGzipReader.h"
+#include "../tools/mappedFile.h"
 #include "SequenceScanner.h"
-// Helper functor to adapt `FILE*` to `std::istream`
-class PopenBuffer : public std::streambuf
+#include "fastqRecords.h"
+
+const size_t OutputFlushSize = 1<<20; //output is accumulated in memory and written to file in blocks of (at least) this many bytes
+
+const size_t RecordTile = 4096; //records are located this many at a time, and then scanned
+
+//!Holds the state needed to parse FASTQ text, scanning each sequence and accumulating the formatted results in Output
+class FastqRecordParser
 {
 	public:
-		PopenBuffer(FILE* file) : file_(file) {}
-	protected:
-		int underflow() override
+		std::string Output;
+
+		FastqRecordParser(SequenceScanner & scanner) : Scanner(scanner){};
+
+		//!Locates the records in the text (see FastqRecordLocator) and scans them, a block of batches at a time (see SequenceScanner::ScanBlock). The text must begin and end on record boundaries.
+		void Parse(std::string_view text)
 		{
-			if (gptr() == egptr())
+			size_t position = 0;
+			while (position < text.size())
 			{
-				size_t n = fread(buffer_, 1, sizeof(buffer_), file_);
-				if (n == 0) return traits_type::eof();
-				setg(buffer_, buffer_, buffer_ + n);
+				Records.clear();
+				position = Locator.Locate(text,position,Records,RecordTile);
+				IDs.clear();
+				size_t nBatches = 0;
+				for (auto & record : Records)
+				{
+					if (nBatches == Batches.size())
+					{
+						Batches.emplace_back();
+					}
+					//reads containing characters outside the alphabet are skipped
+					if (Batches[nBatches].Add(record.Sequence))
+					{
+						IDs.push_back(record.ID);
+						if (Batches[nBatches].Full())
+						{
+							++nBatches;
+						}
+					}
+				}
+				if (nBatches < Batches.size() && Batches[nBatches].Size > 0)
+				{
+					++nBatches;
+				}
+				ScanBlock(nBatches);
 			}
-			return traits_type::to_int_type(*gptr());
 		}
+
+		//!Writes Output to file if it has grown large enough (or if force is true)
+		void Flush(std::ofstream & file, bool force = false)
+		{
+			if (force || Output.size() >= OutputFlushSize)
+			{
+				file.write(Output.data(),Output.size());
+				Output.clear();
+			}
+		}
+
+		//!The number of malformed records skipped so far
+		size_t Malformed() const {return Locator.Malformed;};
 	private:
-		FILE* file_;
-		char buffer_[1024];
-};
+		SequenceScanner & Scanner;
+		std::vector<Sequence::ReadBatch> Batches;
+		std::vector<std::string_view> IDs;
+		std::vector<Record> Results;
+		FastqRecordLocator Locator;
+		std::vector<FastqRecord> Records;
 
+		//scans the reads held in the first nBatches batches, appends their output, and empties them
+		void ScanBlock(int nBatches)
+		{
+			if (nBatches == 0)
+			{
+				return;
+			}
+			Results.resize(nBatches * Sequence::BatchLanes);
+			Scanner.ScanBlock(Batches,nBatches,Results.data());
+			size_t read = 0;
+			for (int b = 0; b < nBatches; ++b)
+			{
+				auto & batch = Batches[b];
+				for (int i = 0; i < batch.Size; ++i)
+				{
+					Output.append(IDs[read]);
+					Output += ' ';
+					Scanner.Format(Results[b*Sequence::BatchLanes + i],batch.Sequences[i],Output);
+					Output += '\n';
+					++read;
+				}
+				batch.Clear();
+			}
+		}
+};
 
-void inline parseLine(std::string_view fileLine,SequenceScanner & scanner, Sequence::DNA & dna, Record & record, bool & nextLineFlag,std::string & gatheredID,std::ofstream & file)
+void inline reportMalformed(const std::string & filename, size_t malformed)
 {
-	if (fileLine[0]=='@')
+	if (malformed > 0)
 	{
-		nextLineFlag = true; 
-		auto firstSpace = std::find(fileLine.begin(),fileLine.end(),' ');
-		gatheredID = std::string(fileLine.begin()+1,firstSpace);
+		LOG(WARN) << malformed << " malformed FASTQ record(s) were skipped in " << filename;
 	}
-	else 
-	{
-		if (nextLineFlag)
-		{	
-			dna.NewSequence(fileLine);
-			if (dna.AlphabetContained)
+}
+
+/*!
+	@brief Re-cuts arbitrarily-split blocks of FASTQ text into pieces which begin and end on record boundaries
+	@details Cuts are only ever made immediately before a record header (see findRecordCut), so each piece parses exactly as it would have done as part of a serial scan.
+
+	Each Push() results in a call to Processor(head, body). The head holds the record(s) carried over from the previous block, completed by the start of this one; it is the only part which is ever copied. The body is a view of the remainder of the block, up to its final cut. Both are valid only during the call.
+*/
+template<typename Func>
+class RecordAligner
+{
+	public:
+		RecordAligner(Func & processor) : Processor(processor){};
+
+		void Push(std::string_view text)
+		{
+			//everything after the last cut might belong to a record which continues into the next block
+			size_t lastCut = findRecordCut(text,text.size(),true);
+			if (lastCut == std::string_view::npos)
 			{
-				scanner.Scan(dna,record);
-				file << gatheredID << " " << dna.FileString << "\n";
+				Carry.append(text);
+				return;
 			}
+
+			size_t firstCut = findRecordCut(text,0,false);
+			std::string_view head = text.substr(0,firstCut);
+			if (Carry.size() > 0)
+			{
+				Carry.append(head);
+				head = Carry;
+			}
+			Processor(head,text.substr(firstCut,lastCut - firstCut));
+			Carry.assign(text.substr(lastCut));
 		}
-		nextLineFlag = false;
-	}
-}
 
+		//! Passes on the final carried-over record(s)
+		void Finish()
+		{
+			Processor(std::string_view(Carry),std::string_view());
+			Carry.clear();
+		}
+	private:
+		Func & Processor;
+		std::string Carry;
+};
 
 
-//this calls to an external tool (gzcat), which unzips the file and then spits it out for us to catch
+/*!
+	@brief Scans record-aligned FASTQ text on every thread of a ParallelPool, whilst writing the output in input order.
+	@details Each body passed to Scan() is cut (on record boundaries, see findRecordCut) into one batch per thread. The concatenated output is byte-identical to a serial run.
+*/
+class OrderedBatchScanner
+{
+	public:
+		OrderedBatchScanner(SequenceScanner & scanner, std::ofstream & file, ParallelPool & pool) : File(file), Pool(pool)
+		{
+			//one extra parser for the head
+			Parsers.reserve(pool.Size()+1);
+			for (size_t i = 0; i < pool.Size()+1; ++i)
+			{
+				Parsers.emplace_back(scanner);
+			}
+		}
+
+		//!Scans the (short) head, and then the body, which is divided between the threads. Both must begin and end on record boundaries
+		void Scan(std::string_view head, std::string_view body)
+		{
+			std::vector<std::string_view> batches = {head};
+			size_t nBatch = Parsers.size() - 1;
+			size_t spacing = body.size()/nBatch;
+			size_t start = 0;
+			for (size_t k = 1; k < nBatch && start < body.size(); ++k)
+			{
+				size_t cut = findRecordCut(body,std::max(start+1,k*spacing),false);
+				if (cut == std::string_view::npos)
+				{
+					break;
+				}
+				batches.push_back(body.substr(start,cut - start));
+				start = cut;
+			}
+			batches.push_back(body.substr(start));
+
+			Pool.For(batches.size(),[&](int k)
+			{
+				Parsers[k].Parse(batches[k]);
+			});
+			for (size_t k = 0; k < batches.size(); ++k)
+			{
+				Parsers[k].Flush(File,true);
+			}
+		}
+
+		//!The number of malformed records skipped so far, across all threads
+		size_t Malformed() const
+		{
+			size_t malformed = 0;
+			for (auto & parser : Parsers)
+			{
+				malformed += parser.Malformed();
+			}
+			return malformed;
+		}
+	private:
+		std::ofstream & File;
+		ParallelPool & Pool;
+		std::vector<FastqRecordParser> Parsers;
+};
+
+
+
+//decompresses the file in-process (see GzipReader), and parses the records directly out of the decompression buffer
 void gzfastQScan(const std::string & filename,SequenceScanner & scanner,std::ofstream & file)
 {
-	std::string cmd = "gzcat " + filename;
-	LOG(DEBUG) << "Calling popen with command '" << cmd << "'";
-	
-	FILE* pipe = popen(cmd.c_str(),"r");
-	if (!pipe)
-	{
-		throw std::runtime_error("Failed to open pipe for command: " + cmd);
-	}
-	
-	PopenBuffer tmp(pipe);
-	std::istream stream(&tmp);
-	
-	std::string PIPE_LINE;
-	
-	Sequence::DNA seq("");
-	Record rec;
-	std::string previousLine;
-	bool readNextLine = false;
-	while (std::getline(stream,PIPE_LINE))
-	{
-		parseLine(PIPE_LINE,scanner,seq,rec,readNextLine,previousLine,file);
-	}
+	FastqRecordParser parser(scanner);
+	auto parseAligned = [&](std::string_view head, std::string_view body){
+		parser.Parse(head);
+		parser.Parse(body);
+		parser.Flush(file);
+	};
+	RecordAligner aligner(parseAligned);
+	forBlockInGzip(filename,Settings.System.BatchSize * 1024 * 1024,[&](std::string_view block){
+		aligner.Push(block);
+	});
+	aligner.Finish();
+	parser.Flush(file,true);
+	reportMalformed(filename,parser.Malformed());
+}
 
-	auto exit = pclose(pipe);
-	if (WEXITSTATUS(exit) != 0)
+//memory-maps the file, and parses the records in place, in blocks of BatchSize
+void fastqScan(const std::string & filename,SequenceScanner & scanner,std::ofstream & file)
+{
+	MappedFile mapping(filename);
+	FastqRecordParser parser(scanner);
+	std::string_view text = mapping.Text();
+	//at least one byte per block, so that every block moves past its start
+	size_t blockSize = std::max<size_t>(Settings.System.BatchSize * 1024 * 1024,1);
+	size_t start = 0;
+	while (start < text.size())
 	{
-		throw std::runtime_error("Command (" + cmd +") returned a non-zero exit code");
+		size_t end = findRecordCut(text,start + blockSize,false);
+		if (end == std::string_view::npos || start + blockSize >= text.size())
+		{
+			end = text.size();
+		}
+		parser.Parse(text.substr(start,end - start));
+		parser.Flush(file);
+		start = end;
 	}
+	parser.Flush(file,true);
+	reportMalformed(filename,parser.Malformed());
 }
 
-void fastqScan(const std::string & filename,SequenceScanner & scanner,std::ofstream & file)
+//decompresses a single file on all threads of the pool, and scans the (ordered) decompressed chunks on all threads
+void parallelGzfastQScan(const std::string & filename,SequenceScanner & scanner,std::ofstream & file, ParallelPool & pool)
 {
-	Sequence::DNA seq("");
-	Record rec;
-	bool readNextLine = false;
-	std::string previousLine;
-	forLineIn(filename,[&](auto line){
-		parseLine(line,scanner,seq,rec,readNextLine,previousLine,file);
-	});
-}
\ No newline at end of file
+	OrderedBatchScanner batcher(scanner,file,pool);
+	auto scanAligned = [&](std::string_view head, std::string_view body){
+		batcher.Scan(head,body);
+	};
+	RecordAligner aligner(scanAligned);
+	size_t chunkSize = Settings.System.DecompressionChunkSize * 1024 * 1024;
+	forChunkInGzip(filename,pool,[&](std::string_view chunk){
+		aligner.Push(chunk);
+	},chunkSize);
+	aligner.Finish();
+	reportMalformed(filename,batcher.Malformed());
+}
+
+//memory-maps a single file, and scans it in large record-aligned blocks on all threads of the pool. Nothing is copied out of the mapping.
+void parallelFastqScan(const std::string & filename,SequenceScanner & scanner,std::ofstream & file, ParallelPool & pool)
+{
+	MappedFile mapping(filename);
+	OrderedBatchScanner batcher(scanner,file,pool);
+	std::string_view text = mapping.Text();
+	//at least one byte per block, so that every block moves past its start
+	size_t blockSize = std::max<size_t>(Settings.System.BatchSize * 1024 * 1024 * pool.Size(),1);
+	size_t start = 0;
+	while (start < text.size())
+	{
+		size_t end = findRecordCut(text,start + blockSize,false);
+		if (end == std::string_view::npos || start + blockSize >= text.size())
+		{
+			end = text.size();
+		}
+		batcher.Scan(std::string_view(),text.substr(start,end - start));
+		start = end;
+	}
+	reportMalformed(filename,batcher.Malformed());
+}
@@ -0,0 +1,268 @@
+#include "fastqRecords.h"
+#include <cstring>
+#if defined(__x86_64__)
+	#include <immintrin.h>
+#endif
+
+namespace
+{
+	const size_t BlockBytes = 64;
+	const size_t TileBlocks = 64; //newline masks are computed 4KiB at a time, so that the kernel is dispatched once per tile, not per block
+
+	//writes a 64-bit mask of the '\n' characters in each 64-byte block
+	typedef void (*NewlineKernel)(const char * data, size_t nBlocks, uint64_t * masks);
+
+	[[maybe_unused]] void newlinesScalar(const char * data, size_t nBlocks, uint64_t * masks)
+	{
+		for (size_t b = 0; b < nBlocks; ++b)
+		{
+			uint64_t mask = 0;
+			const char * block = data + b * BlockBytes;
+			for (size_t i = 0; i < BlockBytes; ++i)
+			{
+				mask |= uint64_t(block[i] == '\n') << i;
+			}
+			masks[b] = mask;
+		}
+	}
+
+	#if defined(__x86_64__)
+	void newlinesSSE2(const char * data, size_t nBlocks, uint64_t * masks)
+	{
+		const __m128i newline = _mm_set1_epi8('\n');
+		for (size_t b = 0; b < nBlocks; ++b)
+		{
+			const char * block = data + b * BlockBytes;
+			uint64_t mask = 0;
+			for (int k = 0; k < 4; ++k)
+			{
+				__m128i chunk = _mm_loadu_si128((const __m128i*)(block + 16*k));
+				uint64_t bits = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk,newline));
+				mask |= bits << (16*k);
+			}
+			masks[b] = mask;
+		}
+	}
+
+	__attribute__((target("avx2"))) void newlinesAVX2(const char * data, size_t nBlocks, uint64_t * masks)
+	{
+		const __m256i newline = _mm256_set1_epi8('\n');
+		for (size_t b = 0; b < nBlocks; ++b)
+		{
+			const char * block = data + b * BlockBytes;
+			__m256i lo = _mm256_loadu_si256((const __m256i*)block);
+			__m256i hi = _mm256_loadu_si256((const __m256i*)(block + 32));
+			uint64_t loBits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo,newline));
+			uint64_t hiBits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi,newline));
+			masks[b] = loBits | (hiBits << 32);
+		}
+	}
+	#endif
+
+	struct KernelChoice
+	{
+		NewlineKernel Function;
+		const char * Name;
+	};
+
+	KernelChoice selectKernel()
+	{
+		#if defined(__x86_64__)
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2"))
+			{
+				return {newlinesAVX2,"avx2"};
+			}
+			return {newlinesSSE2,"sse2"};
+		#else
+			return {newlinesScalar,"scalar"};
+		#endif
+	}
+
+	const KernelChoice & kernel()
+	{
+		static const KernelChoice choice = selectKernel();
+		return choice;
+	}
+
+	//iterates over the newlines of a text, a tile of bitmasks at a time
+	class NewlineFinder
+	{
+		public:
+			NewlineFinder(std::string_view text) : Text(text), TileStart(0), TileEnd(0), Kernel(kernel().Function){};
+
+			//!The position of the first '\n' at or after pos, or Text.size() if there is none
+			size_t Next(size_t pos)
+			{
+				while (pos < Text.size())
+				{
+					if (pos < TileStart || pos >= TileEnd)
+					{
+						Load(pos);
+					}
+					size_t block = (pos - TileStart)/BlockBytes;
+					size_t shift = (pos - TileStart) % BlockBytes;
+					uint64_t mask = Masks[block] >> shift;
+					if (mask != 0)
+					{
+						size_t found = pos + __builtin_ctzll(mask);
+						if (found < Text.size())
+						{
+							return found;
+						}
+						return Text.size();
+					}
+					pos = TileStart + (block + 1) * BlockBytes;
+				}
+				return Text.size();
+			}
+		private:
+			std::string_view Text;
+			size_t TileStart;
+			size_t TileEnd;
+			NewlineKernel Kernel;
+			uint64_t Masks[TileBlocks];
+			char Tail[BlockBytes];
+
+			void Load(size_t pos)
+			{
+				TileStart = pos;
+				size_t available = Text.size() - pos;
+				size_t fullBlocks = std::min(available / BlockBytes, TileBlocks);
+				Kernel(Text.data() + pos, fullBlocks, Masks);
+				TileEnd = TileStart + fullBlocks * BlockBytes;
+				if (fullBlocks < TileBlocks && TileEnd < Text.size())
+				{
+					//the final partial block is copied into a zero-padded buffer, so the kernel never reads past the end of the text
+					size_t remainder = Text.size() - TileEnd;
+					memset(Tail,0,BlockBytes);
+					memcpy(Tail,Text.data() + TileEnd,remainder);
+					Kernel(Tail,1,Masks + fullBlocks);
+					TileEnd += BlockBytes;
+				}
+			}
+	};
+}
+
+const char * FastqRecordLocator::Kernel()
+{
+	return kernel().Name;
+}
+
+size_t FastqRecordLocator::Locate(std::string_view text, size_t offset, std::vector<FastqRecord> & records, size_t maxRecords)
+{
+	NewlineFinder finder(text);
+	size_t target = records.size() + maxRecords;
+	int phase = 0; //0: header, 1: sequence, 2: separator, 3: quality
+	FastqRecord current;
+	size_t pos = offset;
+	while (pos < text.size() && (phase != 0 || records.size() < target))
+	{
+		size_t newline = finder.Next(pos);
+		std::string_view line = text.substr(pos,newline - pos);
+		if (line.size() > 0 && line.back() == '\r')
+		{
+			line.remove_suffix(1);
+		}
+
+		switch (phase)
+		{
+			case 0:
+				if (line.size() > 0 && line[0] == '@')
+				{
+					auto firstSpace = line.find(' ');
+					current.ID = line.substr(1,firstSpace == std::string_view::npos ? std::string_view::npos : firstSpace-1);
+					phase = 1;
+					Resynchronising = false;
+				}
+				else if (line.size() > 0 && !Resynchronising)
+				{
+					//the lines skipped before the next header are counted as a single malformed record
+					++Malformed;
+					Resynchronising = true;
+				}
+				break;
+			case 1:
+				current.Sequence = line;
+				phase = 2;
+				break;
+			case 2:
+				if (line.size() == 0 || line[0] != '+')
+				{
+					++Malformed;
+					Resynchronising = true;
+					phase = 0;
+					if (line.size() > 0 && line[0] == '@')
+					{
+						//this line might be the start of the next record, so it is re-evaluated as a header
+						continue;
+					}
+					break;
+				}
+				records.push_back(current);
+				phase = 3;
+				break;
+			case 3:
+				phase = 0;
+				break;
+		}
+		pos = newline + 1;
+	}
+
+	//a record truncated after its sequence line is still passed on
+	if (phase == 2)
+	{
+		records.push_back(current);
+	}
+	return std::min(pos,text.size());
+}
+
+size_t findRecordCut(std::string_view text, size_t position, bool reverse)
+{
+	//true if the line two below the one beginning at cut exists and begins with '+'
+	auto verified = [&](size_t cut)
+	{
+		size_t second = text.find('\n',cut);
+		if (second == std::string_view::npos)
+		{
+			return false;
+		}
+		size_t third = text.find('\n',second+1);
+		return third != std::string_view::npos && third + 1 < text.size() && text[third+1] == '+';
+	};
+
+	if (reverse)
+	{
+		size_t newline = position;
+		while (newline > 0)
+		{
+			newline = text.rfind("\n@",newline - 1);
+			if (newline == std::string_view::npos)
+			{
+				break;
+			}
+			if (verified(newline + 1))
+			{
+				return newline + 1;
+			}
+		}
+	}
+	else
+	{
+		size_t newline = position == 0 ? 0 : position - 1;
+		while (true)
+		{
+			newline = text.find("\n@",newline);
+			if (newline == std::string_view::npos)
+			{
+				break;
+			}
+			if (verified(newline + 1))
+			{
+				return newline + 1;
+			}
+			++newline;
+		}
+	}
+	return std::string_view::npos;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "../tools/Log.h"
+
+//!A single FASTQ record, as a pair of views into the text it was located in
+struct FastqRecord
+{
+	std::string_view ID; //!< The header line, minus the '@' and anything after the first space
+	std::string_view Sequence;
+};
+
+/*!
+	@brief Splits FASTQ text into (ID, sequence) spans, following the 4-line record structure.
+	@details Newlines are located 64 bytes at a time with SIMD compare-and-movemask (AVX2 or SSE2, chosen at runtime, with a scalar fallback on other architectures), and the resulting bitmasks are walked by a 4-line state machine. Unlike a line-by-line '@' test, this never mistakes a quality line beginning with '@' for a header.
+
+	Records which do not fit the pattern (a header not beginning with '@', or a third line not beginning with '+') are skipped, with the locator resynchronising on the next line beginning with '@'. Each resynchronisation counts as one record in Malformed, however many lines it skips.
+*/
+class FastqRecordLocator
+{
+	public:
+		size_t Malformed = 0;
+
+		/*!
+			@brief Appends up to maxRecords records found in text (starting from offset) to records
+			@param text The text to parse. Must begin (at offset) on a record boundary; the final record may lack a trailing newline.
+			@param offset The point in the text at which to begin
+			@param records The output vector; records are appended
+			@param maxRecords The maximum number of records to append
+			@returns The offset at which the next call should resume. Equal to text.size() once the text is exhausted.
+		*/
+		size_t Locate(std::string_view text, size_t offset, std::vector<FastqRecord> & records, size_t maxRecords);
+
+		//!The name of the newline kernel selected for this CPU
+		static const char * Kernel();
+	private:
+		bool Resynchronising = false; //true whilst lines are being skipped in search of the next header, so that they are counted as one malformed record
+};
+
+/*!
+	@brief Finds a point at which FASTQ text can be cut between records
+	@details A cut is a line-start where the line begins with '@' and the line two below it begins with '+'. Quality lines may begin with '@', but the line two below a quality line is a sequence line, so this is unambiguous for well-formed files. Cuts which cannot be verified (because the text ends too soon) are not returned.
+	@param text The text to search
+	@param position The search begins at (or, if reverse is true, before) this position
+	@param reverse If true, finds the last cut before position, otherwise the first cut at or after it
+	@returns The position of the cut, or npos if none exists. Position 0 is never returned.
+*/
+size_t findRecordCut(std::string_view text, size_t position, bool reverse);
@@ -10,5 +10,10 @@ bool SystemSettings::Validate()
 	
 	GlobalLog::Config.Initialise(Verbosity,true);	
 	
+	if (BatchSize <= 0)
+	{
+		LOG(ERROR) << "The batch size (-batch) must be positive, not " << BatchSize.Value();
+		throw std::runtime_error("Invalid batch size");
+	}
 	return true;
 }
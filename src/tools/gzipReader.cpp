@@ -0,0 +1,94 @@
+#include "gzipReader.h"
+
+GzipReader::GzipReader(const std::string & filename, size_t inputBufferSize) : Filename(filename), Input(inputBufferSize)
+{
+	File = std::fopen(filename.c_str(),"rb");
+	if (!File)
+	{
+		LOG(ERROR) << "Could not find the file '" + filename + "'.\nPlease provide a valid filepath.";
+		throw std::runtime_error("Could not open file");
+	}
+
+	std::memset(&Stream,0,sizeof(Stream));
+	//15 + 32 tells zlib to automatically detect gzip/zlib headers, with the maximum window size
+	if (inflateInit2(&Stream,15 + 32) != Z_OK)
+	{
+		std::fclose(File);
+		throw std::runtime_error("Failed to initialise zlib inflate stream");
+	}
+	Finished = false;
+	MidMember = false;
+	MembersCompleted = 0;
+	FileBytesRead = 0;
+}
+
+GzipReader::~GzipReader()
+{
+	inflateEnd(&Stream);
+	std::fclose(File);
+}
+
+bool GzipReader::RefillInput()
+{
+	size_t n = std::fread(Input.data(),1,Input.size(),File);
+	Stream.next_in = Input.data();
+	Stream.avail_in = n;
+	FileBytesRead += n;
+	return n > 0;
+}
+
+size_t GzipReader::Read(char * destination, size_t capacity)
+{
+	if (Finished)
+	{
+		return 0;
+	}
+	Stream.next_out = reinterpret_cast<unsigned char*>(destination);
+	Stream.avail_out = capacity;
+
+	while (Stream.avail_out > 0)
+	{
+		if (Stream.avail_in == 0 && !RefillInput())
+		{
+			if (MidMember)
+			{
+				LOG(ERROR) << "Unexpected end of file in " << Filename << ", the file is likely truncated";
+				throw std::runtime_error("Gzip decompression failed");
+			}
+			Finished = true;
+			break;
+		}
+
+		bool memberStart = !MidMember;
+		const unsigned char * head = Stream.next_in;
+		size_t headBytes = Stream.avail_in;
+		MidMember = true;
+		int status = inflate(&Stream,Z_NO_FLUSH);
+		if (status == Z_STREAM_END)
+		{
+			//gzip files may consist of many concatenated members (BGZF being the most common example), so reset and keep going if there's more data
+			MidMember = false;
+			++MembersCompleted;
+			inflateReset(&Stream);
+		}
+		else if (status == Z_DATA_ERROR && memberStart && MembersCompleted > 0 && !(head[0] == 0x1f && (headBytes < 2 || head[1] == 0x8b)))
+		{
+			//non-gzip bytes after a complete member -- gzip itself ignores these, so we do the same. Anything which starts like a gzip member (or a bad first member) is corrupt
+			LOG(WARN) << "Trailing garbage after the final gzip member of " << Filename << " ignored";
+			Finished = true;
+			break;
+		}
+		else if (status != Z_OK && status != Z_BUF_ERROR)
+		{
+			LOG(ERROR) << "zlib failed to decompress " << Filename << " (" << (Stream.msg ? Stream.msg : "unknown error") << ")";
+			throw std::runtime_error("Gzip decompression failed");
+		}
+		else if (status == Z_BUF_ERROR && Stream.avail_in > 0)
+		{
+			//no progress was possible despite having input & output space: the stream is corrupt
+			LOG(ERROR) << "zlib could not make progress on " << Filename << ", the file is likely truncated or corrupt";
+			throw std::runtime_error("Gzip decompression failed");
+		}
+	}
+	return capacity - Stream.avail_out;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <zlib.h>
+#include "Log.h"
+
+/*!
+	@brief An in-process streaming decompressor for gzip (and zlib) files, built on top of zlib's inflate.
+	@details Replaces the old popen("gzcat") approach: no child process, no pipe copy, and no dependency on a gzcat binary existing on the host. Compressed input is pulled from disk in large blocks, and decompressed directly into a caller-provided buffer. Multi-member gzip files (i.e. concatenated gzips, which includes BGZF) are handled transparently.
+*/
+class GzipReader
+{
+	public:
+		GzipReader(const std::string & filename, size_t inputBufferSize = 1<<20);
+		~GzipReader();
+
+		/*!
+			@brief Decompresses up to capacity bytes into destination
+			@param destination The buffer to write into. Must be at least capacity bytes long.
+			@param capacity The maximum number of bytes to write
+			@returns The number of bytes written. A value of 0 indicates the end of the file has been reached.
+		*/
+		size_t Read(char * destination, size_t capacity);
+
+		//! The number of bytes of the (compressed) file consumed by inflate so far
+		size_t CompressedBytesRead() const {return FileBytesRead - Stream.avail_in;};
+
+		GzipReader(const GzipReader&) = delete;
+		GzipReader& operator=(const GzipReader&) = delete;
+	private:
+		std::string Filename;
+		FILE * File;
+		z_stream Stream;
+		std::vector<unsigned char> Input;
+		bool Finished;
+		bool MidMember; //true if inflate has consumed part of a gzip member, but not reached its end
+		size_t MembersCompleted; //bytes which fail to inflate are only ignored as trailing garbage after at least one complete member
+		size_t FileBytesRead; //the number of bytes pulled from the file into Input
+
+		bool RefillInput();
+};
+
+
+/*!
+	@brief Reads a stream produced by Reader::Read() in large blocks, passing each to blockProcessor as a string_view into a single reused buffer.
+	@details Blocks end at arbitrary points in the text, and the view is only valid for the duration of the blockProcessor call.
+	@param reader Any object with a size_t Read(char*,size_t) method returning 0 at end-of-stream.
+	@param blockSize The size of the buffer (bytes). Must be non-zero, since a read of zero bytes would be taken for the end of the stream
+	@param blockProcessor A callable accepting a std::string_view
+*/
+template<typename Reader, typename Func>
+void forBlockInReader(Reader & reader, size_t blockSize, Func blockProcessor)
+{
+	if (blockSize == 0)
+	{
+		LOG(ERROR) << "Cannot read a stream in blocks of zero bytes";
+		throw std::runtime_error("Invalid block size");
+	}
+	std::vector<char> buffer(blockSize);
+	size_t n;
+	while ( (n = reader.Read(buffer.data(),blockSize)) > 0)
+	{
+		blockProcessor(std::string_view(buffer.data(),n));
+	}
+}
+
+//! The gzip equivalent of reading a file in blocks: decompresses in-process, passing each block of text as a string_view
+template <typename Func>
+void forBlockInGzip(const std::string& fileName, size_t blockSize, Func blockProcessor)
+{
+	GzipReader reader(fileName);
+	forBlockInReader(reader,blockSize,blockProcessor);
+}
@@ -0,0 +1,203 @@
+#include "hugePageArray.h"
+#include <sys/mman.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "Log.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+namespace
+{
+	const size_t SmallPage = 4096;
+	const size_t HugePage = 2<<20;
+	const size_t GiantPage = 1<<30;
+
+	size_t roundUp(size_t bytes, size_t page)
+	{
+		return (bytes + page - 1)/page * page;
+	}
+
+	//an explicit huge-page mapping; fails (rather than faulting later) if the pool cannot cover it, since the pages are reserved at mmap time
+	void * mapExplicit(size_t length, int sizeFlag)
+	{
+		void * map = mmap(nullptr,length,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | sizeFlag,-1,0);
+		return (map == MAP_FAILED) ? nullptr : map;
+	}
+}
+
+HugePageBuffer::HugePageBuffer(size_t bytes, bool hugePages) : Data(nullptr), Bytes(bytes), Mapped(0), Kind(PageKind::Standard)
+{
+	if (bytes == 0)
+	{
+		return;
+	}
+
+	if (hugePages && bytes >= HugePage)
+	{
+		if (bytes >= GiantPage)
+		{
+			Mapped = roundUp(bytes,GiantPage);
+			Data = mapExplicit(Mapped,MAP_HUGE_1GB);
+			Kind = PageKind::Huge1GiB;
+		}
+		if (!Data)
+		{
+			Mapped = roundUp(bytes,HugePage);
+			Data = mapExplicit(Mapped,MAP_HUGE_2MB);
+			Kind = PageKind::Huge2MiB;
+		}
+		if (!Data)
+		{
+			//transparent huge pages can only back 2 MiB-aligned ranges, so the mapping is over-allocated and then trimmed to alignment
+			Mapped = roundUp(bytes,HugePage);
+			void * map = mmap(nullptr,Mapped + HugePage,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+			if (map != MAP_FAILED)
+			{
+				char * start = static_cast<char*>(map);
+				char * aligned = reinterpret_cast<char*>(roundUp(reinterpret_cast<size_t>(start),HugePage));
+				size_t head = aligned - start;
+				if (head > 0)
+				{
+					munmap(start,head);
+				}
+				if (HugePage - head > 0)
+				{
+					munmap(aligned + Mapped,HugePage - head);
+				}
+				madvise(aligned,Mapped,MADV_HUGEPAGE);
+				Data = aligned;
+				Kind = PageKind::Transparent;
+			}
+		}
+	}
+
+	if (!Data)
+	{
+		Mapped = roundUp(bytes,SmallPage);
+		void * map = mmap(nullptr,Mapped,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+		if (map == MAP_FAILED)
+		{
+			LOG(ERROR) << "Could not allocate " << bytes << " bytes for a score table";
+			throw std::runtime_error("Could not map memory");
+		}
+		Data = map;
+		Kind = PageKind::Standard;
+	}
+}
+
+HugePageBuffer HugePageBuffer::MapFile(int fd, size_t offset, size_t bytes)
+{
+	HugePageBuffer buffer;
+	if (bytes == 0)
+	{
+		return buffer;
+	}
+	void * map = mmap(nullptr,bytes,PROT_READ,MAP_SHARED,fd,offset);
+	if (map == MAP_FAILED)
+	{
+		LOG(ERROR) << "Could not memory-map " << bytes << " bytes of a score table";
+		throw std::runtime_error("Could not map file");
+	}
+	//the whole table will be needed, in random order, so it is read in ahead of the first lookups
+	madvise(map,bytes,MADV_WILLNEED);
+	buffer.Data = map;
+	buffer.Bytes = bytes;
+	buffer.Mapped = bytes;
+	buffer.Kind = PageKind::File;
+	return buffer;
+}
+
+HugePageBuffer::~HugePageBuffer()
+{
+	Release();
+}
+
+HugePageBuffer::HugePageBuffer(HugePageBuffer && other) noexcept : Data(other.Data), Bytes(other.Bytes), Mapped(other.Mapped), Kind(other.Kind)
+{
+	other.Data = nullptr;
+	other.Bytes = 0;
+	other.Mapped = 0;
+}
+
+HugePageBuffer& HugePageBuffer::operator=(HugePageBuffer && other) noexcept
+{
+	if (this != &other)
+	{
+		Release();
+		Data = other.Data;
+		Bytes = other.Bytes;
+		Mapped = other.Mapped;
+		Kind = other.Kind;
+		other.Data = nullptr;
+		other.Bytes = 0;
+		other.Mapped = 0;
+	}
+	return *this;
+}
+
+void HugePageBuffer::Release()
+{
+	if (Data)
+	{
+		munmap(Data,Mapped);
+		Data = nullptr;
+	}
+}
+
+size_t HugePageBuffer::HugeBytes() const
+{
+	if (!Data || Kind == PageKind::Standard || Kind == PageKind::File)
+	{
+		return 0;
+	}
+	if (Kind != PageKind::Transparent)
+	{
+		return Mapped;
+	}
+
+	//smaps lists each mapping as a "start-end perms ..." header followed by its counters. The kernel may have merged the buffer with a neighbouring mapping, so the entry containing Data is used
+	std::ifstream smaps("/proc/self/smaps");
+	std::string line;
+	bool inside = false;
+	size_t start = reinterpret_cast<size_t>(Data);
+	while (std::getline(smaps,line))
+	{
+		size_t dash = line.find('-');
+		size_t space = line.find(' ');
+		if (dash != std::string::npos && space != std::string::npos && dash < space && line.find(':') > space)
+		{
+			size_t low = std::stoull(line.substr(0,dash),nullptr,16);
+			size_t high = std::stoull(line.substr(dash+1,space-dash-1),nullptr,16);
+			inside = (low <= start && start < high);
+		}
+		else if (inside && line.rfind("AnonHugePages:",0) == 0)
+		{
+			std::istringstream counter(line.substr(14));
+			size_t kiB = 0;
+			counter >> kiB;
+			return kiB * 1024;
+		}
+	}
+	return 0;
+}
+
+const char * HugePageBuffer::Name(PageKind kind)
+{
+	switch (kind)
+	{
+		case PageKind::Huge1GiB: return "explicit 1 GiB huge pages";
+		case PageKind::Huge2MiB: return "explicit 2 MiB huge pages";
+		case PageKind::Transparent: return "transparent huge pages";
+		case PageKind::File: return "a shared file mapping";
+		default: return "standard pages";
+	}
+}
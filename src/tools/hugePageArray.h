@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+
+//! The kinds of page which can back a HugePageBuffer
+enum class PageKind {Standard,Transparent,Huge2MiB,Huge1GiB,File};
+
+/*!
+	@brief An anonymous memory mapping, backed by huge pages where the system allows
+	@details Explicit (hugetlbfs) pages are tried first -- 1 GiB pages for mappings of at least 1 GiB, then 2 MiB pages -- which succeed only if the administrator has reserved a pool of them. Failing that, the mapping is aligned to 2 MiB and advised to use transparent huge pages (MADV_HUGEPAGE), which the kernel may or may not grant as the pages are touched. The memory is never initialised by the buffer: anonymous pages arrive zeroed on first touch.
+*/
+class HugePageBuffer
+{
+	public:
+		HugePageBuffer() : Data(nullptr), Bytes(0), Mapped(0), Kind(PageKind::Standard){};
+
+		/*!
+			@param bytes The size of the buffer
+			@param hugePages If false, the buffer is an ordinary mapping of 4 KiB pages
+		*/
+		HugePageBuffer(size_t bytes, bool hugePages);
+
+		/*!
+			@brief A read-only, shared mapping of bytes of an open file, starting at offset (a multiple of the page size)
+			@details The pages are those of the page cache, so they are shared by every process mapping the same file. Throws if the mapping fails
+		*/
+		static HugePageBuffer MapFile(int fd, size_t offset, size_t bytes);
+		~HugePageBuffer();
+
+		HugePageBuffer(const HugePageBuffer&) = delete;
+		HugePageBuffer& operator=(const HugePageBuffer&) = delete;
+		HugePageBuffer(HugePageBuffer && other) noexcept;
+		HugePageBuffer& operator=(HugePageBuffer && other) noexcept;
+
+		void * Data;
+		size_t Bytes; //!< The size requested
+		size_t Mapped; //!< The size of the mapping, rounded up to whole pages
+		PageKind Kind;
+
+		/*!
+			@brief The number of bytes of the buffer which are currently backed by huge pages
+			@details For explicit pages this is the whole mapping. For transparent huge pages it is read from /proc/self/smaps, and so only counts pages which have been touched (and which the kernel chose to promote)
+		*/
+		size_t HugeBytes() const;
+
+		//! A description of the kind of page, for reports
+		static const char * Name(PageKind kind);
+	private:
+		void Release();
+};
+
+/*!
+	@brief A fixed-size array of trivially-copyable elements held in a HugePageBuffer, used for the large precomputed tables
+	@details Unlike std::vector, Allocate() does not construct its elements -- the owner is expected to initialise every element before use (see SequenceScanner::Precompute), so that each page is only written once. Until then the elements are zero bytes.
+*/
+template<class T>
+class HugePageArray
+{
+	static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>,"HugePageArray elements are neither constructed nor destroyed");
+	public:
+		HugePageArray() : Count(0){};
+
+		//! Discards the contents, and allocates space for n (uninitialised) elements
+		void Allocate(size_t n, bool hugePages)
+		{
+			Buffer = HugePageBuffer(n * sizeof(T),hugePages);
+			Count = n;
+		}
+
+		//! Discards the contents, and takes n elements from an existing buffer (e.g. HugePageBuffer::MapFile). Read-only buffers must not be written through
+		void Adopt(HugePageBuffer && buffer, size_t n)
+		{
+			Buffer = std::move(buffer);
+			Count = n;
+		}
+
+		size_t size() const {return Count;};
+		T * data() {return static_cast<T*>(Buffer.Data);};
+		const T * data() const {return static_cast<const T*>(Buffer.Data);};
+		T & operator[](size_t i) {return data()[i];};
+		const T & operator[](size_t i) const {return data()[i];};
+		T * begin() {return data();};
+		T * end() {return data() + Count;};
+
+		PageKind Kind() const {return Buffer.Kind;};
+		size_t HugeBytes() const {return Buffer.HugeBytes();};
+	private:
+		HugePageBuffer Buffer;
+		size_t Count;
+};
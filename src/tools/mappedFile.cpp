@@ -0,0 +1,58 @@
+#include "mappedFile.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string & filename, bool sequential)
+{
+	int fd = open(filename.c_str(),O_RDONLY);
+	if (fd < 0)
+	{
+		LOG(ERROR) << "Could not find the file '" + filename + "'.\nPlease provide a valid filepath.";
+		throw std::runtime_error("Could not open file");
+	}
+	struct stat info;
+	fstat(fd,&info);
+	Length = info.st_size;
+	Data = nullptr;
+	if (Length > 0) //mmap refuses zero-length mappings, so empty files are simply left unmapped
+	{
+		void * map = mmap(nullptr,Length,PROT_READ,MAP_PRIVATE,fd,0);
+		if (map == MAP_FAILED)
+		{
+			close(fd);
+			LOG(ERROR) << "Could not memory-map the file '" << filename << "'";
+			throw std::runtime_error("Could not map file");
+		}
+		if (sequential)
+		{
+			madvise(map,Length,MADV_SEQUENTIAL);
+		}
+		Data = static_cast<const char*>(map);
+	}
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if (Data)
+	{
+		munmap(const_cast<char*>(Data),Length);
+	}
+}
+
+std::string_view MappedFile::Text() const
+{
+	return std::string_view(Data,Length);
+}
+
+const unsigned char * MappedFile::Bytes() const
+{
+	return reinterpret_cast<const unsigned char*>(Data);
+}
+
+size_t MappedFile::Size() const
+{
+	return Length;
+}
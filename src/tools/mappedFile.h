@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include "Log.h"
+
+/*!
+	@brief A read-only memory mapping of an entire file.
+	@details Allows a file to be parsed in place -- string_views into Text() remain valid for the lifetime of the object, so no line (or any other part of the file) ever needs to be copied out.
+*/
+class MappedFile
+{
+	public:
+		/*!
+			@param filename The file to map
+			@param sequential If true, advises the kernel that the file will be read from front to back (MADV_SEQUENTIAL), enabling aggressive read-ahead
+		*/
+		MappedFile(const std::string & filename, bool sequential = true);
+		~MappedFile();
+
+		std::string_view Text() const;
+		const unsigned char * Bytes() const;
+		size_t Size() const;
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+	private:
+		const char * Data;
+		size_t Length;
+};
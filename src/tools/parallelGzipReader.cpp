@@ -0,0 +1,792 @@
+#include "parallelGzipReader.h"
+#include <zlib.h>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	const size_t WindowSize = 32768; //the maximum deflate back-reference distance
+	const size_t TrialBytes = 1<<16; //how much plausible output a speculative block start must produce before being accepted
+	const uint64_t NoBoundary = std::numeric_limits<uint64_t>::max();
+
+	/*
+		Reads a gzip member header starting at offset.
+		Returns the header length, or 0 if the bytes are not a valid header.
+		If the header contains a BGZF 'BC' subfield, blockSize is set to the total member length (BSIZE+1)
+	*/
+	size_t parseGzipHeader(const unsigned char * data, size_t size, size_t offset, size_t * blockSize = nullptr)
+	{
+		const size_t fixedHeader = 10;
+		if (offset + fixedHeader > size)
+		{
+			return 0;
+		}
+		const unsigned char * h = data + offset;
+		if (h[0] != 0x1f || h[1] != 0x8b || h[2] != 8 || (h[3] & 0xe0))
+		{
+			return 0;
+		}
+		unsigned char flags = h[3];
+		size_t pos = offset + fixedHeader;
+		if (flags & 4) //FEXTRA
+		{
+			if (pos + 2 > size)
+			{
+				return 0;
+			}
+			size_t xlen = data[pos] | (data[pos+1] << 8);
+			pos += 2;
+			if (pos + xlen > size)
+			{
+				return 0;
+			}
+			size_t sub = pos;
+			while (sub + 4 <= pos + xlen)
+			{
+				size_t slen = data[sub+2] | (data[sub+3] << 8);
+				if (blockSize && data[sub] == 'B' && data[sub+1] == 'C' && slen == 2 && sub + 6 <= pos + xlen)
+				{
+					*blockSize = (data[sub+4] | (data[sub+5] << 8)) + 1;
+				}
+				sub += 4 + slen;
+			}
+			pos += xlen;
+		}
+		for (int flag : {8,16}) //FNAME and FCOMMENT are zero-terminated strings
+		{
+			if (flags & flag)
+			{
+				while (pos < size && data[pos] != 0)
+				{
+					++pos;
+				}
+				if (pos >= size)
+				{
+					return 0;
+				}
+				++pos;
+			}
+		}
+		if (flags & 2) //FHCRC
+		{
+			pos += 2;
+		}
+		if (pos > size)
+		{
+			return 0;
+		}
+		return pos - offset;
+	}
+
+	//LSB-first bit reader, as required by deflate. Only used for validating candidate block headers, so speed is not critical.
+	class BitCursor
+	{
+		public:
+			BitCursor(const unsigned char * data, size_t size, uint64_t bit) : Data(data), Limit(size*8), Position(bit){};
+			bool Read(int n, int & value)
+			{
+				if (Position + n > Limit)
+				{
+					return false;
+				}
+				value = 0;
+				for (int i = 0; i < n; ++i)
+				{
+					value |= ((Data[Position>>3] >> (Position & 7)) & 1) << i;
+					++Position;
+				}
+				return true;
+			}
+		private:
+			const unsigned char * Data;
+			uint64_t Limit;
+			uint64_t Position;
+	};
+
+	//A canonical huffman decoder, in the style of zlib's puff.c
+	struct Huffman
+	{
+		short Count[16];
+		short Symbol[320];
+	};
+
+	//returns 0 for a complete code, >0 for an incomplete code, and <0 for an oversubscribed code
+	int buildHuffman(Huffman & h, const short * lengths, int n)
+	{
+		std::fill(h.Count,h.Count+16,0);
+		for (int i = 0; i < n; ++i)
+		{
+			++h.Count[lengths[i]];
+		}
+		if (h.Count[0] == n)
+		{
+			return 0;
+		}
+		int left = 1;
+		for (int len = 1; len < 16; ++len)
+		{
+			left <<= 1;
+			left -= h.Count[len];
+			if (left < 0)
+			{
+				return left;
+			}
+		}
+		short offsets[16];
+		offsets[1] = 0;
+		for (int len = 1; len < 15; ++len)
+		{
+			offsets[len+1] = offsets[len] + h.Count[len];
+		}
+		for (int i = 0; i < n; ++i)
+		{
+			if (lengths[i] != 0)
+			{
+				h.Symbol[offsets[lengths[i]]++] = i;
+			}
+		}
+		return left;
+	}
+
+	int decodeSymbol(BitCursor & in, const Huffman & h)
+	{
+		int code = 0;
+		int first = 0;
+		int index = 0;
+		for (int len = 1; len < 16; ++len)
+		{
+			int bit;
+			if (!in.Read(1,bit))
+			{
+				return -1;
+			}
+			code |= bit;
+			int count = h.Count[len];
+			if (code - count < first)
+			{
+				return h.Symbol[index + (code - first)];
+			}
+			index += count;
+			first += count;
+			first <<= 1;
+			code <<= 1;
+		}
+		return -1;
+	}
+
+	//zlib accepts incomplete literal/distance codes only when they consist of a single code of length 1
+	bool acceptableCode(const short * lengths, int n)
+	{
+		Huffman h;
+		int status = buildHuffman(h,lengths,n);
+		return status == 0 || (status > 0 && n - h.Count[0] == 1);
+	}
+
+	/*
+		Tests whether a non-final, dynamic-huffman deflate block header begins at the given bit.
+		The header is decoded in full and all three huffman codes checked for validity, which rejects all but a tiny fraction of random bit positions before zlib is ever involved.
+	*/
+	bool plausibleBlockHeader(const unsigned char * data, size_t size, uint64_t bit)
+	{
+		BitCursor in(data,size,bit);
+		int final, type, nlen, ndist, ncode;
+		if (!in.Read(1,final) || final != 0 || !in.Read(2,type) || type != 2)
+		{
+			return false;
+		}
+		if (!in.Read(5,nlen) || !in.Read(5,ndist) || !in.Read(4,ncode))
+		{
+			return false;
+		}
+		nlen += 257;
+		ndist += 1;
+		ncode += 4;
+		if (nlen > 286 || ndist > 30)
+		{
+			return false;
+		}
+
+		static const short order[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+		short lengths[320] = {0};
+		for (int i = 0; i < ncode; ++i)
+		{
+			int len;
+			if (!in.Read(3,len))
+			{
+				return false;
+			}
+			lengths[order[i]] = len;
+		}
+		Huffman codeLengths;
+		if (buildHuffman(codeLengths,lengths,19) != 0)
+		{
+			return false;
+		}
+
+		int index = 0;
+		while (index < nlen + ndist)
+		{
+			int symbol = decodeSymbol(in,codeLengths);
+			if (symbol < 0)
+			{
+				return false;
+			}
+			if (symbol < 16)
+			{
+				lengths[index++] = symbol;
+				continue;
+			}
+			int len = 0;
+			int repeat;
+			if (symbol == 16)
+			{
+				if (index == 0 || !in.Read(2,repeat))
+				{
+					return false;
+				}
+				len = lengths[index-1];
+				repeat += 3;
+			}
+			else if (symbol == 17)
+			{
+				if (!in.Read(3,repeat))
+				{
+					return false;
+				}
+				repeat += 3;
+			}
+			else
+			{
+				if (!in.Read(7,repeat))
+				{
+					return false;
+				}
+				repeat += 11;
+			}
+			if (index + repeat > nlen + ndist)
+			{
+				return false;
+			}
+			while (repeat-- > 0)
+			{
+				lengths[index++] = len;
+			}
+		}
+
+		return lengths[256] != 0 && acceptableCode(lengths,nlen) && acceptableCode(lengths+nlen,ndist);
+	}
+
+	bool plausibleText(const char * text, size_t n)
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			unsigned char c = text[i];
+			if ((c < 0x20 || c > 0x7e) && c != '\n' && c != '\r' && c != '\t' && c != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//A thin wrapper around a raw (headerless) zlib inflate stream which can be started at any bit offset of a memory-mapped file
+	class RawInflater
+	{
+		public:
+			RawInflater()
+			{
+				std::memset(&Stream,0,sizeof(Stream));
+				if (inflateInit2(&Stream,-15) != Z_OK)
+				{
+					throw std::runtime_error("Failed to initialise zlib inflate stream");
+				}
+			}
+			~RawInflater()
+			{
+				inflateEnd(&Stream);
+			}
+
+			void Begin(const unsigned char * data, size_t size, uint64_t bit, std::string_view dictionary)
+			{
+				inflateReset(&Stream);
+				if (dictionary.size() > 0)
+				{
+					inflateSetDictionary(&Stream,reinterpret_cast<const Bytef*>(dictionary.data()),dictionary.size());
+				}
+				size_t byte = bit >> 3;
+				int shift = bit & 7;
+				if (shift > 0)
+				{
+					inflatePrime(&Stream,8 - shift,data[byte] >> shift);
+					++byte;
+				}
+				Base = data;
+				End = data + size;
+				Stream.next_in = const_cast<Bytef*>(data + byte);
+				Stream.avail_in = 0;
+			}
+
+			//inflates into out[length...], stopping at the next block boundary, or once length reaches limit. Grows out as needed.
+			int Inflate(std::string & out, size_t & length, size_t limit)
+			{
+				if (Stream.avail_in == 0)
+				{
+					Stream.avail_in = std::min<size_t>(End - Stream.next_in,1<<30);
+				}
+				if (length == out.size())
+				{
+					out.resize(std::max<size_t>(2*out.size(),1<<16));
+				}
+				size_t space = std::min(out.size(),limit) - length;
+				Stream.next_out = reinterpret_cast<Bytef*>(out.data() + length);
+				Stream.avail_out = std::min<size_t>(space,1<<30);
+				int status = inflate(&Stream,Z_BLOCK);
+				length = reinterpret_cast<char*>(Stream.next_out) - out.data();
+				return status;
+			}
+
+			bool AtBlockEnd() const {return Stream.data_type & 128;};
+			bool InputExhausted() const {return Stream.avail_in == 0 && Stream.next_in == End;};
+			uint64_t BitPosition() const {return (Stream.next_in - Base)*8 - (Stream.data_type & 7);};
+			size_t BytePosition() const {return Stream.next_in - Base;};
+		private:
+			z_stream Stream;
+			const unsigned char * Base;
+			const unsigned char * End;
+	};
+
+	bool trialDecode(RawInflater & z, const unsigned char * data, size_t size, uint64_t bit, const std::string & sentinel)
+	{
+		z.Begin(data,size,bit,sentinel);
+		std::string out;
+		size_t length = 0;
+		while (length < TrialBytes)
+		{
+			size_t previous = length;
+			int status = z.Inflate(out,length,TrialBytes);
+			if (!plausibleText(out.data() + previous,length - previous))
+			{
+				return false;
+			}
+			if (status == Z_STREAM_END)
+			{
+				return true;
+			}
+			if (status != Z_OK && !(status == Z_BUF_ERROR && !z.InputExhausted()))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//returns the final (up to) 32KiB of the concatenation of head and tail
+	std::string trailingWindow(const std::string & head, const std::vector<std::string_view> & tail)
+	{
+		std::string window;
+		size_t needed = WindowSize;
+		for (size_t i = tail.size(); i-- > 0 && needed > 0;)
+		{
+			size_t take = std::min(needed,tail[i].size());
+			window.insert(0,tail[i].substr(tail[i].size() - take));
+			needed -= take;
+		}
+		if (needed > 0)
+		{
+			size_t take = std::min(needed,head.size());
+			window.insert(0,head.substr(head.size() - take));
+		}
+		return window;
+	}
+}
+
+ParallelGzipReader::ParallelGzipReader(const std::string & filename, ParallelPool & pool, size_t chunkSize) : Filename(filename), Pool(pool), ChunkSize(std::max<size_t>(chunkSize,WindowSize)), File(filename,false)
+{
+	Data = File.Bytes();
+	Size = File.Size();
+
+	Position = {0,false};
+	Finished = (Size == 0);
+	MemberCrc = crc32(0,nullptr,0);
+	MemberLength = 0;
+	MemberIndex = 0;
+	size_t blockSize = 0;
+	BGZF = !Finished && parseGzipHeader(Data,Size,0,&blockSize) > 0 && blockSize > 0;
+	if (BGZF)
+	{
+		IndexBGZF();
+	}
+	LOG(DEBUG) << "Decompressing " << filename << " in parallel (" << (BGZF ? "BGZF blocks" : "speculative block detection") << ")";
+}
+
+const std::vector<std::string_view> & ParallelGzipReader::Chunks() const
+{
+	return Output;
+}
+
+void ParallelGzipReader::IndexBGZF()
+{
+	//BGZF block headers state the size of their member, so we can hop from header to header without decompressing anything
+	size_t offset = 0;
+	while (offset < Size)
+	{
+		size_t blockSize = 0;
+		if (parseGzipHeader(Data,Size,offset,&blockSize) == 0 || blockSize == 0 || offset + blockSize > Size)
+		{
+			LOG(WARN) << "Malformed BGZF block at byte " << offset << " of " << Filename << ", falling back to speculative decompression";
+			BGZF = false;
+			MemberOffsets.clear();
+			return;
+		}
+		MemberOffsets.push_back(offset);
+		offset += blockSize;
+	}
+}
+
+bool ParallelGzipReader::FindBlockStart(uint64_t fromBit, uint64_t toBit, GzipBoundary & result) const
+{
+	RawInflater z;
+	std::string sentinel(WindowSize,0);
+	toBit = std::min<uint64_t>(toBit,Size*8);
+	for (uint64_t bit = fromBit; bit < toBit; ++bit)
+	{
+		if (plausibleBlockHeader(Data,Size,bit) && trialDecode(z,Data,Size,bit,sentinel))
+		{
+			result = {bit,true};
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<GzipBoundary> ParallelGzipReader::PlanRound()
+{
+	size_t nChunks = Pool.Size();
+	std::vector<GzipBoundary> starts = {Position};
+	const GzipBoundary eof = {Size*8,false};
+
+	if (BGZF)
+	{
+		//group consecutive blocks until each chunk holds at least ChunkSize compressed bytes
+		size_t idx = MemberIndex;
+		for (size_t k = 0; k < nChunks; ++k)
+		{
+			size_t chunkStart = MemberOffsets[idx];
+			while (idx < MemberOffsets.size() && MemberOffsets[idx] - chunkStart < ChunkSize)
+			{
+				++idx;
+			}
+			if (idx == MemberOffsets.size())
+			{
+				break;
+			}
+			starts.push_back({MemberOffsets[idx]*8,false});
+		}
+		if (idx == MemberOffsets.size())
+		{
+			starts.push_back(eof);
+		}
+		return starts;
+	}
+
+	//search for block starts near each of the nominal chunk offsets simultaneously
+	size_t startByte = Position.Bit >> 3;
+	auto found = Pool.For(nChunks,[&](int k)
+	{
+		size_t nominal = startByte + (k+1)*ChunkSize;
+		GzipBoundary candidate = {NoBoundary,true};
+		if (nominal < Size && !FindBlockStart(nominal*8,(nominal + ChunkSize)*8,candidate))
+		{
+			//no boundary found: the previous chunk will overrun this nominal position and stop at the next true boundary it meets
+			candidate = {nominal*8,true};
+		}
+		return candidate;
+	});
+	for (size_t k = 0; k < nChunks; ++k)
+	{
+		if (found[k].Bit == NoBoundary)
+		{
+			starts.push_back(eof);
+			return starts;
+		}
+		starts.push_back(found[k]);
+	}
+	return starts;
+}
+
+void ParallelGzipReader::DecodeChunk(GzipChunk & chunk, const std::vector<GzipBoundary> & starts, int index, bool knownWindow) const
+{
+	chunk.Start = starts[index];
+	chunk.Valid = true;
+	bool speculative = chunk.Start.InMember && !knownWindow;
+
+	std::string dictionary;
+	if (chunk.Start.InMember)
+	{
+		dictionary = knownWindow ? Window : std::string(WindowSize,0);
+	}
+
+	RawInflater z;
+	GzipBoundary pos = chunk.Start;
+	size_t target = index + 1;
+	size_t length = 0;
+	size_t firstMemberEnd = std::string::npos; //dictionary references (and hence markers) can only occur before the first member ends
+
+	//checks if the chunk has reached (or overrun) the start of a later chunk in the round
+	auto reached = [&](GzipBoundary p)
+	{
+		while (target < starts.size() && starts[target].Bit < p.Bit)
+		{
+			++target;
+		}
+		if (target == starts.size() || starts[target] == p)
+		{
+			chunk.Stop = p;
+			chunk.EndTarget = std::min(target,starts.size()-1);
+			return true;
+		}
+		return false;
+	};
+	auto fail = [&](const std::string & reason)
+	{
+		if (speculative)
+		{
+			//a false-positive block start: this chunk will be overrun by its predecessor, so quietly give up
+			chunk.Valid = false;
+			return;
+		}
+		LOG(ERROR) << "Failed to decompress " << Filename << " (" << reason << ")";
+		throw std::runtime_error("Gzip decompression failed");
+	};
+
+	if (chunk.Start.InMember)
+	{
+		z.Begin(Data,Size,pos.Bit,dictionary);
+	}
+	while (true)
+	{
+		if (!pos.InMember)
+		{
+			size_t byte = pos.Bit >> 3;
+			size_t header = parseGzipHeader(Data,Size,byte);
+			if (header == 0)
+			{
+				//a member header is only ever expected at the start of the file or just after a complete member, so only bytes after a member which do not start like one are trailing garbage
+				bool magic = byte < Size && Data[byte] == 0x1f && (byte + 1 == Size || Data[byte+1] == 0x8b);
+				if (byte == 0 || magic)
+				{
+					fail("no valid gzip member header at byte " + std::to_string(byte));
+					return;
+				}
+				if (!speculative)
+				{
+					LOG(WARN) << "Trailing garbage after the final gzip member of " << Filename << " ignored";
+				}
+				reached({Size*8,false});
+				break;
+			}
+			pos = {(byte + header)*8,true};
+			z.Begin(Data,Size,pos.Bit,{});
+			if (reached(pos))
+			{
+				break;
+			}
+			continue;
+		}
+
+		int status = z.Inflate(chunk.Data,length,std::string::npos);
+		if (status == Z_STREAM_END)
+		{
+			size_t byte = z.BytePosition() + 8; //skip the CRC32 & ISIZE trailer
+			if (byte > Size)
+			{
+				fail("file truncated");
+				return;
+			}
+			firstMemberEnd = std::min(firstMemberEnd,length);
+			chunk.MemberEnds.push_back(length);
+			chunk.Trailers.push_back(z.BytePosition());
+			pos = {byte*8,false};
+			if (reached(pos))
+			{
+				break;
+			}
+			continue;
+		}
+		if (status == Z_BUF_ERROR && z.InputExhausted())
+		{
+			fail("file truncated");
+			return;
+		}
+		if (status != Z_OK && status != Z_BUF_ERROR)
+		{
+			fail("corrupt deflate stream");
+			return;
+		}
+		if (z.AtBlockEnd())
+		{
+			pos = {z.BitPosition(),true};
+			if (reached(pos))
+			{
+				break;
+			}
+		}
+	}
+	chunk.Data.resize(length);
+
+	if (!speculative)
+	{
+		return;
+	}
+
+	//locate the bytes which came from the unknown window, then decode them twice more to learn which window byte each one was
+	size_t scanLimit = std::min(firstMemberEnd,length);
+	const char * text = chunk.Data.data();
+	for (const char * p = text; (p = static_cast<const char*>(std::memchr(p,0,text + scanLimit - p))) != nullptr; ++p)
+	{
+		chunk.MarkerPositions.push_back(p - text);
+	}
+	if (chunk.MarkerPositions.size() == 0)
+	{
+		return;
+	}
+	chunk.MarkerWindowIndices.assign(chunk.MarkerPositions.size(),0);
+	size_t limit = chunk.MarkerPositions.back() + 1;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		std::string indexDictionary(WindowSize,0);
+		for (size_t i = 0; i < WindowSize; ++i)
+		{
+			indexDictionary[i] = (i >> (8*pass)) & 0xff;
+		}
+		std::string indexed;
+		size_t indexedLength = 0;
+		z.Begin(Data,Size,chunk.Start.Bit,indexDictionary);
+		while (indexedLength < limit)
+		{
+			int status = z.Inflate(indexed,indexedLength,limit);
+			if (status == Z_STREAM_END)
+			{
+				break;
+			}
+			if (status != Z_OK && status != Z_BUF_ERROR)
+			{
+				fail("corrupt deflate stream");
+				return;
+			}
+		}
+		for (size_t m = 0; m < chunk.MarkerPositions.size(); ++m)
+		{
+			chunk.MarkerWindowIndices[m] |= static_cast<unsigned char>(indexed[chunk.MarkerPositions[m]]) << (8*pass);
+		}
+	}
+}
+
+void ParallelGzipReader::ResolveMarkers(GzipChunk & chunk, std::string_view window) const
+{
+	size_t missing = WindowSize - window.size(); //if less than 32KiB of output precedes the chunk, the front of the window does not exist
+	for (size_t m = 0; m < chunk.MarkerPositions.size(); ++m)
+	{
+		size_t idx = chunk.MarkerWindowIndices[m];
+		if (idx < missing)
+		{
+			LOG(ERROR) << "Failed to decompress " << Filename << " (back-reference before the start of the file)";
+			throw std::runtime_error("Gzip decompression failed");
+		}
+		chunk.Data[chunk.MarkerPositions[m]] = window[idx - missing];
+	}
+}
+
+void ParallelGzipReader::CheckMembers(const GzipChunk & chunk)
+{
+	for (size_t m = 0; m <= chunk.MemberEnds.size(); ++m)
+	{
+		size_t pieceStart = (m == 0) ? 0 : chunk.MemberEnds[m-1];
+		size_t pieceEnd = (m == chunk.MemberEnds.size()) ? chunk.Data.size() : chunk.MemberEnds[m];
+		MemberCrc = crc32_combine(MemberCrc,chunk.PieceCrcs[m],pieceEnd - pieceStart);
+		MemberLength += pieceEnd - pieceStart;
+		if (m == chunk.MemberEnds.size())
+		{
+			break;
+		}
+
+		//the trailer is little-endian, and ISIZE is the length modulo 2^32
+		const unsigned char * trailer = Data + chunk.Trailers[m];
+		uint32_t crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | (static_cast<uint32_t>(trailer[3]) << 24);
+		uint32_t isize = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | (static_cast<uint32_t>(trailer[7]) << 24);
+		if (crc != MemberCrc || isize != static_cast<uint32_t>(MemberLength))
+		{
+			LOG(ERROR) << "Failed to decompress " << Filename << " (the gzip member ending at byte " << chunk.Trailers[m] + 8 << " fails its CRC32/length check, the file is likely corrupt)";
+			throw std::runtime_error("Gzip decompression failed");
+		}
+		MemberCrc = crc32(0,nullptr,0);
+		MemberLength = 0;
+	}
+}
+
+bool ParallelGzipReader::NextRound()
+{
+	Output.clear();
+	if (Finished)
+	{
+		return false;
+	}
+
+	auto starts = PlanRound();
+	Round.assign(starts.size() - 1,GzipChunk());
+	Pool.For(Round.size(),[&](int k)
+	{
+		DecodeChunk(Round[k],starts,k,k==0);
+	});
+
+	//stitch the chunks together: follow the chain of exact landings from the first chunk, filling in each chunk's unknown window as we go
+	std::vector<size_t> used;
+	size_t k = 0;
+	while (true)
+	{
+		auto & chunk = Round[k];
+		if (!chunk.Valid)
+		{
+			LOG(ERROR) << "Failed to decompress " << Filename << " (corrupt deflate stream)";
+			throw std::runtime_error("Gzip decompression failed");
+		}
+		if (chunk.MarkerPositions.size() > 0)
+		{
+			ResolveMarkers(chunk,trailingWindow(Window,Output));
+		}
+		Output.push_back(chunk.Data);
+		used.push_back(k);
+		if (chunk.EndTarget >= (int)Round.size())
+		{
+			Position = chunk.Stop;
+			break;
+		}
+		k = chunk.EndTarget;
+	}
+	if (BGZF)
+	{
+		//an overrun can only happen if a BGZF block lied about its size, but make sure the next round starts on the right block regardless
+		MemberIndex = std::lower_bound(MemberOffsets.begin(),MemberOffsets.end(),Position.Bit >> 3) - MemberOffsets.begin();
+	}
+	Window = trailingWindow(Window,Output);
+
+	//the pieces of each chunk are checksummed in parallel, then joined in order
+	Pool.For(used.size(),[&](int u)
+	{
+		auto & chunk = Round[used[u]];
+		chunk.PieceCrcs.clear();
+		size_t pieceStart = 0;
+		for (size_t m = 0; m <= chunk.MemberEnds.size(); ++m)
+		{
+			size_t pieceEnd = (m == chunk.MemberEnds.size()) ? chunk.Data.size() : chunk.MemberEnds[m];
+			chunk.PieceCrcs.push_back(crc32_z(crc32(0,nullptr,0),reinterpret_cast<const Bytef*>(chunk.Data.data() + pieceStart),pieceEnd - pieceStart));
+			pieceStart = pieceEnd;
+		}
+	});
+	for (size_t u : used)
+	{
+		CheckMembers(Round[u]);
+	}
+	Finished = (Position.Bit >= Size*8) || (BGZF && MemberIndex == MemberOffsets.size());
+	return true;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "Log.h"
+#include "mappedFile.h"
+#include "../parallel/parallel.h"
+
+/*!
+	@brief A position in a gzip file from which decompression can begin.
+	@details Bit is an absolute bit offset into the compressed file. If InMember is false, Bit is byte aligned and points at a gzip member header; otherwise it points at the first bit of a deflate block header inside a member.
+*/
+struct GzipBoundary
+{
+	uint64_t Bit;
+	bool InMember;
+	bool operator==(const GzipBoundary & other) const {return Bit == other.Bit && InMember == other.InMember;};
+};
+
+/*!
+	@brief The decompressed output of a single chunk, plus the bookkeeping needed to stitch it to its neighbours
+*/
+struct GzipChunk
+{
+	GzipBoundary Start;
+	GzipBoundary Stop; //!< Where decoding actually stopped. Always a true block/member boundary if Valid.
+	std::string Data;
+	std::vector<size_t> MarkerPositions; //!< Positions in Data which refer back into the (unknown) 32KiB window preceding Start
+	std::vector<uint16_t> MarkerWindowIndices; //!< The window index each marker refers to
+	std::vector<size_t> MemberEnds; //!< Positions in Data at which a gzip member ended
+	std::vector<size_t> Trailers; //!< The byte offset in the file of the CRC32 & ISIZE trailer of each of those members
+	std::vector<uint32_t> PieceCrcs; //!< The CRC32 of each piece of Data between member ends (one more than there are MemberEnds)
+	int EndTarget; //!< The index (within the round) of the chunk whose Start this chunk stopped on
+	bool Valid;
+};
+
+/*!
+	@brief Decompresses a single gzip file on all the threads of a ParallelPool, returning the output in order.
+	@details The file is memory-mapped and divided into chunks of (approximately) ChunkSize compressed bytes, which are decoded in rounds of one chunk per thread.
+
+	BGZF files (and other files whose first member carries the BGZF 'BC' extra field) are split on the member boundaries given in the block headers, each of which can be decompressed independently.
+
+	All other gzip files have their chunk starts found speculatively: starting from the nominal offset, each bit position is tested for a plausible dynamic-Huffman deflate block header, and candidates are confirmed by a trial decode. A chunk beginning mid-stream cannot see the 32KiB window it refers back into, so it is decoded against a sentinel dictionary (marking unknown bytes) and two index dictionaries (which record the low and high byte of the window index each unknown byte came from). Once the preceding chunk has been decoded, the markers are replaced with the true bytes. A chunk is only used if the decoder of the chunk before it lands exactly on its start, so a false-positive boundary costs time, not correctness.
+
+	Since chunks may begin midway through a member, each chunk's CRC32 is computed in pieces (split at the member ends it contains) once its markers are resolved. The pieces are joined in order with crc32_combine, and each member's total is checked against its CRC32 & ISIZE trailer, as the serial GzipReader does.
+*/
+class ParallelGzipReader
+{
+	public:
+		ParallelGzipReader(const std::string & filename, ParallelPool & pool, size_t chunkSize = 4<<20);
+
+		/*!
+			@brief Decompresses the next round of chunks in parallel
+			@returns false if the end of the file has already been reached (in which case no chunks are returned)
+		*/
+		bool NextRound();
+
+		//! The in-order, fully resolved output of the most recent round. Views are invalidated by the next call to NextRound()
+		const std::vector<std::string_view> & Chunks() const;
+
+		ParallelGzipReader(const ParallelGzipReader&) = delete;
+		ParallelGzipReader& operator=(const ParallelGzipReader&) = delete;
+	private:
+		std::string Filename;
+		ParallelPool & Pool;
+		size_t ChunkSize;
+
+		MappedFile File;
+		const unsigned char * Data;
+		size_t Size;
+
+		bool BGZF;
+		std::vector<uint64_t> MemberOffsets; //only populated for BGZF files
+		size_t MemberIndex;
+
+		GzipBoundary Position; //where the next round begins
+		bool Finished;
+		std::string Window; //the final (up to) 32KiB of output from the previous round
+		uint32_t MemberCrc; //the CRC32 of the output so far of the member in progress at the end of the previous round
+		size_t MemberLength; //and its length
+
+		std::vector<GzipChunk> Round;
+		std::vector<std::string_view> Output;
+
+		void IndexBGZF();
+		std::vector<GzipBoundary> PlanRound();
+		bool FindBlockStart(uint64_t fromBit, uint64_t toBit, GzipBoundary & result) const;
+		void DecodeChunk(GzipChunk & chunk, const std::vector<GzipBoundary> & starts, int index, bool knownWindow) const;
+		void ResolveMarkers(GzipChunk & chunk, std::string_view window) const;
+		void CheckMembers(const GzipChunk & chunk);
+};
+
+
+/*!
+	@brief Decompresses a gzip file in parallel, passing each decompressed chunk (in file order) to chunkProcessor
+	@param chunkProcessor A callable accepting a std::string_view. Chunk boundaries fall at arbitrary points in the text.
+*/
+template<typename Func>
+void forChunkInGzip(const std::string & fileName, ParallelPool & pool, Func chunkProcessor, size_t chunkSize = 4<<20)
+{
+	ParallelGzipReader reader(fileName,pool,chunkSize);
+	while (reader.NextRound())
+	{
+		for (auto & chunk : reader.Chunks())
+		{
+			chunkProcessor(chunk);
+		}
+	}
+}
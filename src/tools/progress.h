@@ -2,6 +2,7 @@
 
 
 #include "Log.h"
+#include <cmath>
 
 
 template<char Symbol = '#',unsigned int MaxMarks =16>
@@ -4,4 +4,5 @@
 #include "fileparser.h"
 #include "MakeString.h"
 #include "progress.h"
-#include "recursiveFileSearch.h"
\ No newline at end of file
+#include "recursiveFileSearch.h"
+#include "gzipReader.h"
\ No newline at end of file